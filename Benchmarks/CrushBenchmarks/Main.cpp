@@ -0,0 +1,341 @@
+/*
+  ==================================================================================
+
+    Micro benchmarks for the bit crush functions of a JUCE VST video game sample
+    emulation plugin. Times the sample rate conversion, PCM and DPCM bit depth
+    conversions, the full bit crush and the NES DMC encoder over a sweep of clip
+    lengths, every NES and SNES bit depth and every NES sample rate, and writes
+    the results as JSON so runs from different versions can be diffed
+
+    Built as a JUCE console application from this file and the plugin's Source
+    files, with the same modules and JucePlugin_ preprocessor definitions as the
+    plugin (so the processor compiles the same way). Build with optimisations on
+
+    Usage: CrushBenchmarks [--output results.json] [--quick]
+
+  ==================================================================================
+*/
+
+#include <JuceHeader.h>
+#include <iostream>
+#include "../../Source/PluginProcessor.h"
+
+//==============================================================================
+// One benchmark case, and its results once run
+struct BenchmarkCase
+{
+    juce::String function;      // Which function is being timed
+    juce::String console;       // Console the parameters come from
+    double lengthSeconds = 0;   // Length of the clip
+    int bitDepth = 0;           // Bit depth converted to, (0 if the function doesn't use it)
+    int rateIndex = -1;         // Index into the console's sample rate choices, (-1 if the function doesn't use it)
+    float sampleRate = 0;       // Sample rate emulated, (0 if the function doesn't use it)
+    bool DPCM = false;          // Whether DPCM is used
+    int DPCMBit = 0;            // The bit size of the DPCM, (0 if not used)
+
+    int iterations = 0;         // Number of times the function was timed
+    double nsPerSample = 0;     // Median time per sample of the clip
+    double samplesPerSecond = 0;// Median throughput
+};
+
+//==============================================================================
+class CrushBenchmarks
+{
+public:
+    explicit CrushBenchmarks(bool quickRun)
+        : quick(quickRun)
+    {
+        // Take the NES rates from the same table as the processor, so the sweep always matches what the plugin offers
+        NESSampleRates.addArray(ConsoleProfiles::NES::sampleRates, ConsoleProfiles::NES::numSampleRates);
+    }
+
+    // Builds the sweep of cases for every function
+    void addCases()
+    {
+        const juce::Array<double> lengths = quick ? juce::Array<double>{ 0.1, 1.0 } : juce::Array<double>{ 0.1, 0.5, 1.0, 2.0, 5.0, 10.0 };
+
+        for (auto lengthSeconds : lengths)
+        {
+            // Sample rate conversion, for every NES rate and the SNES rate
+            for (int rateIndex = 0; rateIndex < NESSampleRates.size(); rateIndex++)
+            {
+                cases.add({ "convertSampleSampleRate", "NES", lengthSeconds, 0, rateIndex, NESSampleRates[rateIndex] });
+            }
+            cases.add({ "convertSampleSampleRate", "SNES", lengthSeconds, 0, 0, ConsoleProfiles::SNES::sampleRates[0] });
+
+            // PCM bit depth conversion, for every NES and SNES bit depth
+            for (int bitDepth = 1; bitDepth <= maxNESBitDepth; bitDepth++)
+            {
+                cases.add({ "convertSampleBitDepthPCM", "NES", lengthSeconds, bitDepth });
+            }
+            for (int bitDepth = 1; bitDepth <= maxSNESBitDepth; bitDepth++)
+            {
+                cases.add({ "convertSampleBitDepthPCM", "SNES", lengthSeconds, bitDepth });
+            }
+
+            // DPCM bit depth conversion and the full bit crush, for every NES bit depth at every NES rate
+            for (int bitDepth = 1; bitDepth <= maxNESBitDepth; bitDepth++)
+            {
+                for (int rateIndex = 0; rateIndex < NESSampleRates.size(); rateIndex++)
+                {
+                    cases.add({ "convertSampleBitDepthDPCM", "NES", lengthSeconds, bitDepth, rateIndex, NESSampleRates[rateIndex], true, 1 });
+                    cases.add({ "bitCrushSample", "NES", lengthSeconds, bitDepth, rateIndex, NESSampleRates[rateIndex], false, 0 });
+                    cases.add({ "bitCrushSample", "NES", lengthSeconds, bitDepth, rateIndex, NESSampleRates[rateIndex], true, 1 });
+                }
+            }
+
+            // The packed DMC encoder, for every NES rate, (to compare with the 1 bit float DPCM path above)
+            for (int rateIndex = 0; rateIndex < NESSampleRates.size(); rateIndex++)
+            {
+                cases.add({ "encodeSampleDMC", "NES", lengthSeconds, 1, rateIndex, NESSampleRates[rateIndex], true, 1 });
+            }
+
+            // And for every SNES bit depth and DPCM bit size
+            for (int bitDepth = 1; bitDepth <= maxSNESBitDepth; bitDepth++)
+            {
+                for (int DPCMBit = 1; DPCMBit <= maxSNESDPCMBit; DPCMBit++)
+                {
+                    cases.add({ "convertSampleBitDepthDPCM", "SNES", lengthSeconds, bitDepth, 0, ConsoleProfiles::SNES::sampleRates[0], true, DPCMBit });
+                    cases.add({ "bitCrushSample", "SNES", lengthSeconds, bitDepth, 0, ConsoleProfiles::SNES::sampleRates[0], true, DPCMBit });
+                }
+                cases.add({ "bitCrushSample", "SNES", lengthSeconds, bitDepth, 0, ConsoleProfiles::SNES::sampleRates[0], false, 0 });
+            }
+
+            // Quantising to level codes through each console's pipeline, against the general kernel with the same settings
+            for (int bitDepth = 1; bitDepth <= maxNESBitDepth; bitDepth++)
+            {
+                for (auto function : { "quantiseSampleCodes", "encodeLevelCodes" })
+                {
+                    cases.add({ function, "NES", lengthSeconds, bitDepth, NESSampleRates.size() - 1, NESSampleRates.getLast(), false, 0 });
+                    cases.add({ function, "NES", lengthSeconds, bitDepth, NESSampleRates.size() - 1, NESSampleRates.getLast(), true, 1 });
+                }
+            }
+            for (int bitDepth = 1; bitDepth <= maxSNESBitDepth; bitDepth++)
+            {
+                for (auto function : { "quantiseSampleCodes", "encodeLevelCodes" })
+                {
+                    cases.add({ function, "SNES", lengthSeconds, bitDepth, 0, ConsoleProfiles::SNES::sampleRates[0], true, maxSNESDPCMBit });
+                }
+            }
+
+            // The BRR encoder's filter and shift search, (the bit depth is set by the blocks, so is given as the 15 bit output)
+            cases.add({ "convertSampleBRR", "SNES", lengthSeconds, 15, 0, ConsoleProfiles::SNES::sampleRates[0] });
+        }
+    }
+
+    // Runs every case, printing a line for each as it finishes
+    void run()
+    {
+        for (auto& benchmarkCase : cases)
+        {
+            runCase(benchmarkCase);
+
+            std::cerr << benchmarkCase.function << " " << benchmarkCase.console << " " << juce::String(benchmarkCase.lengthSeconds, 1) << " s"
+                      << " bits " << benchmarkCase.bitDepth << " rate " << juce::String(benchmarkCase.sampleRate, 2)
+                      << (benchmarkCase.DPCM ? " DPCM " + juce::String(benchmarkCase.DPCMBit) : juce::String())
+                      << ": " << juce::String(benchmarkCase.nsPerSample, 3) << " ns/sample" << std::endl;
+        }
+    }
+
+    // Every case and its results as JSON
+    juce::String toJSON() const
+    {
+        juce::Array<juce::var> results;
+
+        for (auto& benchmarkCase : cases)
+        {
+            auto* result = new juce::DynamicObject();
+            result->setProperty("function", benchmarkCase.function);
+            result->setProperty("console", benchmarkCase.console);
+            result->setProperty("lengthSeconds", benchmarkCase.lengthSeconds);
+            result->setProperty("bitDepth", benchmarkCase.bitDepth);
+            result->setProperty("rateIndex", benchmarkCase.rateIndex);
+            result->setProperty("sampleRate", benchmarkCase.sampleRate);
+            result->setProperty("DPCM", benchmarkCase.DPCM);
+            result->setProperty("DPCMBit", benchmarkCase.DPCMBit);
+            result->setProperty("iterations", benchmarkCase.iterations);
+            result->setProperty("nsPerSample", benchmarkCase.nsPerSample);
+            result->setProperty("samplesPerSecond", benchmarkCase.samplesPerSecond);
+            results.add(juce::var(result));
+        }
+
+        auto* root = new juce::DynamicObject();
+        root->setProperty("cpu", juce::SystemStats::getCpuModel());
+        root->setProperty("os", juce::SystemStats::getOperatingSystemName());
+        root->setProperty("clipSampleRate", clipSampleRate);
+        root->setProperty("results", results);
+
+        return juce::JSON::toString(juce::var(root));
+    }
+
+private:
+    // Times one case, repeating it until enough time has been spent to give a steady median
+    void runCase(BenchmarkCase& benchmarkCase)
+    {
+        const int numSamples = (int)(benchmarkCase.lengthSeconds * clipSampleRate);
+        juce::AudioSampleBuffer source = makeTestClip(numSamples);
+        juce::AudioSampleBuffer data(source.getNumChannels(), numSamples);
+
+        juce::Array<double> times;
+        double totalTime = 0;
+
+        while (times.size() < minIterations || (totalTime < minTotalSeconds && times.size() < maxIterations))
+        {
+            data.makeCopyOf(source, true);  // Fresh copy each time, (outside the timed section)
+
+            const auto start = juce::Time::getHighResolutionTicks();
+            runFunction(benchmarkCase, data);
+            const auto end = juce::Time::getHighResolutionTicks();
+
+            double seconds = juce::Time::highResolutionTicksToSeconds(end - start);
+            times.add(seconds);
+            totalTime += seconds;
+        }
+
+        times.sort();
+        double median = times[times.size() / 2];
+
+        benchmarkCase.iterations = times.size();
+        benchmarkCase.nsPerSample = median * 1.0e9 / numSamples;
+        benchmarkCase.samplesPerSecond = numSamples / juce::jmax(median, 1.0e-12);
+    }
+
+    void runFunction(const BenchmarkCase& benchmarkCase, juce::AudioSampleBuffer& data)
+    {
+        if (benchmarkCase.function == "convertSampleSampleRate")
+        {
+            processor.convertSampleSampleRate(&data, clipSampleRate, benchmarkCase.sampleRate);
+        }
+        else if (benchmarkCase.function == "convertSampleBitDepthPCM")
+        {
+            processor.convertSampleBitDepthPCM(&data, benchmarkCase.bitDepth);
+        }
+        else if (benchmarkCase.function == "convertSampleBitDepthDPCM")
+        {
+            processor.convertSampleBitDepthDPCM(&data, clipSampleRate, benchmarkCase.sampleRate, benchmarkCase.bitDepth, benchmarkCase.DPCMBit);
+        }
+        else if (benchmarkCase.function == "bitCrushSample")
+        {
+            processor.bitCrushSample(&data, clipSampleRate, benchmarkCase.sampleRate, benchmarkCase.bitDepth, benchmarkCase.DPCM, benchmarkCase.DPCMBit);
+        }
+        else if (benchmarkCase.function == "encodeSampleDMC")
+        {
+            processor.encodeSampleDMC(data, clipSampleRate, benchmarkCase.sampleRate);
+        }
+        else if (benchmarkCase.function == "quantiseSampleCodes")
+        {
+            // Timed along with working out the hold values it quantises, as the renderer's stages do between them
+            juce::AudioSampleBuffer holdValues;
+            processor.getSampleHoldValues(data, clipSampleRate, benchmarkCase.sampleRate, holdValues);
+            processor.quantiseSampleCodes(holdValues, data.getNumSamples(), clipSampleRate, ConsoleTables::getConsoleFromName(benchmarkCase.console),
+                                          benchmarkCase.sampleRate, benchmarkCase.bitDepth, benchmarkCase.DPCM, benchmarkCase.DPCMBit);
+        }
+        else if (benchmarkCase.function == "encodeLevelCodes")
+        {
+            // The general kernel, with the bit depth and slope only known at run time
+            const CrushKernels::HoldSections sections(clipSampleRate, benchmarkCase.sampleRate);
+            const int numCodes = sections.getNumSections(data.getNumSamples());
+            LevelCodes codes(data.getNumChannels(), numCodes, benchmarkCase.bitDepth, sections, data.getNumSamples());
+            const int slopeBitDepth = benchmarkCase.DPCM ? benchmarkCase.DPCMBit : 0;
+            std::vector<float> holdValues((size_t)numCodes);
+
+            for (int channel = 0; channel < data.getNumChannels(); channel++)
+            {
+                CrushKernels::getHoldValues(data.getReadPointer(channel), data.getNumSamples(), sections, numCodes, holdValues.data());
+                int DPCMIndex = -1;
+
+                if (codes.hasEightBitCodes())
+                {
+                    CrushKernels::encodeLevelCodes(holdValues.data(), numCodes, benchmarkCase.bitDepth, slopeBitDepth, codes.getEightBitCodes(channel), DPCMIndex);
+                }
+                else
+                {
+                    CrushKernels::encodeLevelCodes(holdValues.data(), numCodes, benchmarkCase.bitDepth, slopeBitDepth, codes.getSixteenBitCodes(channel), DPCMIndex);
+                }
+            }
+        }
+        else if (benchmarkCase.function == "convertSampleBRR")
+        {
+            processor.convertSampleBRR(&data, clipSampleRate, benchmarkCase.sampleRate);
+        }
+    }
+
+    // A stereo clip of a decaying chord with some noise, so every level and step size gets used
+    static juce::AudioSampleBuffer makeTestClip(int numSamples)
+    {
+        juce::AudioSampleBuffer clip(2, numSamples);
+        juce::Random random(1234);  // Fixed seed so every run crushes the same data
+
+        for (int channel = 0; channel < clip.getNumChannels(); channel++)
+        {
+            auto* channelData = clip.getWritePointer(channel);
+
+            for (int i = 0; i < numSamples; i++)
+            {
+                double time = i / clipSampleRate;
+                double tone = std::sin(juce::MathConstants<double>::twoPi * 220.0 * time)
+                            + 0.5 * std::sin(juce::MathConstants<double>::twoPi * (277.18 + channel) * time)
+                            + 0.25 * std::sin(juce::MathConstants<double>::twoPi * 329.63 * time);
+
+                channelData[i] = (float)(0.5 * tone * std::exp(-time) + 0.05 * (random.nextFloat() * 2.0f - 1.0f));
+            }
+        }
+
+        return clip;
+    }
+
+    static constexpr double clipSampleRate{ 44100.0 };  // Rate the clips are at
+    static constexpr int maxNESBitDepth{ ConsoleProfiles::NES::maxBitDepth };          // Highest NES bit depth
+    static constexpr int maxSNESBitDepth{ ConsoleProfiles::SNES::maxBitDepth };        // Highest SNES bit depth
+    static constexpr int maxSNESDPCMBit{ ConsoleProfiles::SNES::maxSlopeBitDepth };    // Highest SNES DPCM bit size
+
+    static constexpr int minIterations{ 5 };            // Fewest times a case is timed
+    static constexpr int maxIterations{ 1000 };         // Most times a case is timed
+    static constexpr double minTotalSeconds{ 0.05 };    // Time spent on a case before stopping, (once it has been timed the fewest times)
+
+    const bool quick;                                   // Whether to only sweep a couple of clip lengths
+    ProjectCodeAudioProcessor processor;                // Processor whose functions are timed
+    juce::Array<float> NESSampleRates;                  // Every NES sample rate choice
+    juce::Array<BenchmarkCase> cases;                   // Every case in the sweep
+};
+
+//==============================================================================
+int main(int argc, char* argv[])
+{
+    juce::ScopedJuceInitialiser_GUI juceInitialiser;    // The processor's parameters need the message manager to exist
+
+    juce::StringArray args;
+    for (int i = 1; i < argc; i++)
+    {
+        args.add(argv[i]);
+    }
+
+    int outputArg = args.indexOf("--output");
+    juce::File outputFile;
+    if (outputArg >= 0 && outputArg + 1 < args.size())
+    {
+        outputFile = juce::File::getCurrentWorkingDirectory().getChildFile(args[outputArg + 1]);
+    }
+
+    CrushBenchmarks benchmarks(args.contains("--quick"));
+    benchmarks.addCases();
+    benchmarks.run();
+
+    auto json = benchmarks.toJSON();
+
+    // Results go to the output file if one was given, otherwise to stdout, (progress always goes to stderr)
+    if (outputFile != juce::File())
+    {
+        if (!outputFile.replaceWithText(json))
+        {
+            std::cerr << "Could not write " << outputFile.getFullPathName() << std::endl;
+            return 1;
+        }
+    }
+    else
+    {
+        std::cout << json << std::endl;
+    }
+
+    return 0;
+}
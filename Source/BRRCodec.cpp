@@ -0,0 +1,233 @@
+/*
+  ==================================================================================
+
+    Implementation file for the SNES BRR (bit rate reduction) codec of a JUCE VST
+    video game sample emulation plugin. Encodes samples into the 9 byte blocks the
+    SNES DSP plays, and decodes them back exactly as the DSP does
+
+  ==================================================================================
+*/
+
+#include "BRRCodec.h"
+
+namespace BRRCodec
+{
+    // The prediction each filter makes from the previous two output samples, with the DSP's own shifts and rounding
+    template <int filter>
+    static inline int predict(int old, int older) noexcept
+    {
+        switch (filter)
+        {
+            case 1:  return old + ((-old) >> 4);
+            case 2:  return old * 2 + ((-old * 3) >> 5) - older + (older >> 4);
+            case 3:  return old * 2 + ((-old * 13) >> 6) - older + ((older * 3) >> 4);
+            default: return 0;
+        }
+    }
+
+    static inline int predict(int filter, int old, int older) noexcept
+    {
+        switch (filter)
+        {
+            case 1:  return predict<1>(old, older);
+            case 2:  return predict<2>(old, older);
+            case 3:  return predict<3>(old, older);
+            default: return 0;
+        }
+    }
+
+    // Adds the prediction to a decoded nibble, then clips to 16 bits and drops the top bit as the DSP does
+    static inline int reconstruct(int nibbleValue, int prediction) noexcept
+    {
+        int value = juce::jlimit(-32768, 32767, nibbleValue + prediction);
+        return (int)((juce::uint32)value << 17) >> 17;
+    }
+
+    // The value a nibble stands for at a shift, (shifts 13 to 15 only give 0 or -2048, as on the hardware)
+    static inline int expandNibble(int nibble, int shift) noexcept
+    {
+        return shift <= maxShift ? (nibble * (1 << shift)) >> 1 : (nibble < 0 ? -2048 : 0);
+    }
+
+    //==============================================================================
+    // Result of searching for the best filter and shift for a block
+    struct BlockChoice
+    {
+        int filter = 0;
+        int shift = 0;
+    };
+
+    static constexpr int numLanes{ 16 };    // Shifts tried at once, (0 to 12, padded out with 12 so the lanes fill whole vectors)
+
+    // Tries every shift for one filter, with one shift per lane, so the compiler can vectorise across the lanes. Adds each
+    // shift's squared error over the block to errors
+    template <int filter>
+    static void tryFilter(const int* targets, int old, int older, float* errors) noexcept
+    {
+        int laneOld[numLanes], laneOlder[numLanes], multiplier[numLanes];
+        float scale[numLanes], laneError[numLanes];
+
+        for (int lane = 0; lane < numLanes; lane++)
+        {
+            const int shift = juce::jmin(lane, maxShift);
+            laneOld[lane] = old;
+            laneOlder[lane] = older;
+            multiplier[lane] = 1 << shift;
+            scale[lane] = 2.0f / (float)(1 << shift);   // Nibble steps per unit of residual
+            laneError[lane] = 0.0f;
+        }
+
+        for (int i = 0; i < samplesPerBlock; i++)
+        {
+            const int target = targets[i];
+
+            for (int lane = 0; lane < numLanes; lane++)
+            {
+                int prediction = predict<filter>(laneOld[lane], laneOlder[lane]);
+                int nibble = (int)std::floor((float)(target - prediction) * scale[lane] + 0.5f);
+                nibble = nibble < -8 ? -8 : (nibble > 7 ? 7 : nibble);
+
+                int value = (nibble * multiplier[lane]) >> 1;
+                value = juce::jlimit(-32768, 32767, value + prediction);
+                value = (int)((juce::uint32)value << 17) >> 17;
+
+                float error = (float)(target - value);
+                laneError[lane] += error * error;
+
+                laneOlder[lane] = laneOld[lane];
+                laneOld[lane] = value;
+            }
+        }
+
+        for (int lane = 0; lane < numLanes; lane++)
+        {
+            errors[lane] = laneError[lane];
+        }
+    }
+
+    // Finds the filter and shift with the least error for a block, starting from the given history
+    static BlockChoice searchBlock(const int* targets, int old, int older, bool allowPrediction) noexcept
+    {
+        float errors[numFilters][numLanes];
+
+        tryFilter<0>(targets, old, older, errors[0]);
+        if (allowPrediction)
+        {
+            tryFilter<1>(targets, old, older, errors[1]);
+            tryFilter<2>(targets, old, older, errors[2]);
+            tryFilter<3>(targets, old, older, errors[3]);
+        }
+
+        BlockChoice best;
+        float bestError = INFINITY;
+
+        for (int filter = 0; filter < (allowPrediction ? numFilters : 1); filter++)
+        {
+            for (int shift = 0; shift <= maxShift; shift++)
+            {
+                if (errors[filter][shift] < bestError)
+                {
+                    bestError = errors[filter][shift];
+                    best = { filter, shift };
+                }
+            }
+        }
+
+        return best;
+    }
+
+    // Encodes a block with a filter and shift, from the decoder's real history, returning its squared error and updating the
+    // history. Writes the nibbles if a destination is given, (the same nibbles and values tryFilter worked the error out from)
+    static float encodeBlock(const int* targets, int filter, int shift, int& old, int& older, juce::uint8* nibbles) noexcept
+    {
+        const float scale = 2.0f / (float)(1 << shift);
+        float totalError = 0.0f;
+
+        for (int i = 0; i < samplesPerBlock; i++)
+        {
+            int prediction = predict(filter, old, older);
+            int nibble = juce::jlimit(-8, 7, (int)std::floor((float)(targets[i] - prediction) * scale + 0.5f));
+            int value = reconstruct(expandNibble(nibble, shift), prediction);
+
+            float error = (float)(targets[i] - value);
+            totalError += error * error;
+
+            older = old;
+            old = value;
+
+            if (nibbles != nullptr)
+            {
+                nibbles[i / 2] |= (juce::uint8)((nibble & 0x0f) << ((i & 1) ? 0 : 4));
+            }
+        }
+
+        return totalError;
+    }
+
+    //==============================================================================
+    void encode(const float* data, int numSamples, juce::uint8* blocks)
+    {
+        History history;
+        encode(data, numSamples, blocks, history, true);
+    }
+
+    void encode(const float* data, int numSamples, juce::uint8* blocks, History& history, bool isLastPart)
+    {
+        const int numBlocks = getNumBlocks(numSamples);
+
+        // The 15 bit values the blocks should decode to, padded with silence to whole blocks
+        std::vector<int> targets((size_t)numBlocks * samplesPerBlock, 0);
+        for (int i = 0; i < numSamples; i++)
+        {
+            targets[(size_t)i] = juce::jlimit(-16384, 16383, juce::roundToInt(data[i] * 16383.0f));
+        }
+
+        // Each block is searched in order, from the history the blocks before it actually decode to, so every filter and
+        // shift is tried with the prediction the DSP will really make
+        for (int block = 0; block < numBlocks; block++)
+        {
+            const int* blockTargets = targets.data() + (size_t)block * samplesPerBlock;
+
+            // The first block has no history to predict from, so always uses filter 0
+            const auto choice = searchBlock(blockTargets, history.old, history.older, history.started);
+
+            juce::uint8* blockBytes = blocks + (size_t)block * bytesPerBlock;
+            std::fill(blockBytes, blockBytes + bytesPerBlock, (juce::uint8)0);
+
+            blockBytes[0] = (juce::uint8)((choice.shift << 4) | (choice.filter << 2) | (isLastPart && block == numBlocks - 1 ? 1 : 0));
+            encodeBlock(blockTargets, choice.filter, choice.shift, history.old, history.older, blockBytes + 1);
+            history.started = true;
+        }
+    }
+
+    void decode(const juce::uint8* blocks, int numBlocks, juce::int16* destination)
+    {
+        History history;
+        decode(blocks, numBlocks, destination, history);
+    }
+
+    void decode(const juce::uint8* blocks, int numBlocks, juce::int16* destination, History& history)
+    {
+        for (int block = 0; block < numBlocks; block++)
+        {
+            const juce::uint8* blockBytes = blocks + (size_t)block * bytesPerBlock;
+            const int shift = blockBytes[0] >> 4;
+            const int filter = (blockBytes[0] >> 2) & 3;
+
+            for (int i = 0; i < samplesPerBlock; i++)
+            {
+                // Sign extend the nibble, (high nibble first)
+                int nibble = (blockBytes[1 + i / 2] >> ((i & 1) ? 0 : 4)) & 0x0f;
+                nibble = nibble >= 8 ? nibble - 16 : nibble;
+
+                int value = reconstruct(expandNibble(nibble, shift), predict(filter, history.old, history.older));
+
+                history.older = history.old;
+                history.old = value;
+                *destination++ = (juce::int16)value;
+            }
+
+            history.started = true;
+        }
+    }
+}
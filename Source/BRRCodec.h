@@ -0,0 +1,55 @@
+/*
+  ==================================================================================
+
+    Header file for the SNES BRR (bit rate reduction) codec of a JUCE VST video
+    game sample emulation plugin. Encodes samples into the 9 byte blocks the SNES
+    DSP plays, and decodes them back exactly as the DSP does
+
+  ==================================================================================
+*/
+
+#pragma once
+
+#include <JuceHeader.h>
+
+namespace BRRCodec
+{
+    // Each block is a header byte, (shift in the top 4 bits, filter in the next 2, then the loop and end flags), followed
+    // by 16 signed 4 bit samples, two to a byte with the first in the high nibble
+    constexpr int samplesPerBlock{ 16 };
+    constexpr int bytesPerBlock{ 9 };
+    constexpr int numFilters{ 4 };
+    constexpr int maxShift{ 12 };       // Shifts above 12 are only partly usable on the hardware, so are never chosen
+
+    inline int getNumBlocks(int numSamples) noexcept { return (numSamples + samplesPerBlock - 1) / samplesPerBlock; }
+
+    // Threads shared by every instance of the plugin to encode several channels at the same time. A channel's blocks are
+    // always encoded in order on one thread, as each block's search needs the history the blocks before it decode to
+    class EncoderPool : public juce::ThreadPool
+    {
+    public:
+        EncoderPool() : juce::ThreadPool(juce::jmax(1, juce::SystemStats::getNumCpus() - 1)) {}
+    };
+
+    // The last two values decoded, which each block is predicted from, so a long sample can be encoded or decoded a part at a time
+    struct History
+    {
+        int old = 0;            // The last value decoded
+        int older = 0;          // The one before it
+        bool started = false;   // Whether any blocks have been done yet, (the first block has no history so never predicts)
+    };
+
+    // Encodes the data (normalised to -1 to 1) into getNumBlocks(numSamples) blocks, setting the end flag on the last one.
+    // Every filter and shift is tried for each block, from the history the blocks before it decode to
+    void encode(const float* data, int numSamples, juce::uint8* blocks);
+
+    // As above, but carries on from the history of the parts encoded before. Every part but the last should be whole
+    // blocks, and only the last part's last block gets the end flag
+    void encode(const float* data, int numSamples, juce::uint8* blocks, History& history, bool isLastPart);
+
+    // Decodes blocks into 16 samples each, as the 15 bit values the DSP produces (so -16384 to 16383)
+    void decode(const juce::uint8* blocks, int numBlocks, juce::int16* destination);
+
+    // As above, but carries on from the history of the blocks decoded before
+    void decode(const juce::uint8* blocks, int numBlocks, juce::int16* destination, History& history);
+}
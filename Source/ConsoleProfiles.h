@@ -0,0 +1,209 @@
+/*
+  ==================================================================================
+
+    Header file for the console profiles of a JUCE VST video game sample
+    emulation plugin. Each emulated console's sampling hardware (its sample
+    rates, bit depths and how it encodes samples) is described at compile time,
+    so the crush pipeline can be built for each console with its limits folded in
+
+  ==================================================================================
+*/
+
+#pragma once
+
+#include <JuceHeader.h>
+
+// The consoles that can be emulated, in the same order as the Console parameter's choices
+enum class Console
+{
+    NES,
+    SNES,
+    GameBoy,
+    GBA
+};
+
+namespace ConsoleProfiles
+{
+    // The ways a console can store a sample, in the order of its mode parameter's choices
+    enum class Encoding
+    {
+        PCM,    // A level from the bit depth's grid for every sample
+        DPCM,   // A step of limited size from the sample before
+        BRR,    // SNES blocks of 4 bit samples with a shift and prediction filter
+        WaveRAM,    // GameBoy wave channel frames of 32 4 bit samples, played through a volume shift
+        DirectSound // GBA 8 bit signed PCM, mixed with the other voices in integer arithmetic at the mixing rate
+    };
+
+    // The GameBoy wave channel's sample rate for a value of its 11 bit frequency register, (its timer steps to the next
+    // sample every 2048 - value ticks of a 2097152 Hz clock)
+    constexpr float getWaveChannelRate(int frequencyRegister) noexcept
+    {
+        return (float)(2097152.0 / (2048 - frequencyRegister));
+    }
+
+    // The GBA's Direct Sound mixing rate for a number of samples mixed per video frame, (the mixer fills its FIFO buffer once
+    // per frame, and a frame is 280896 cycles of the 16777216 Hz CPU clock)
+    constexpr float getDirectSoundRate(int samplesPerFrame) noexcept
+    {
+        return (float)(16777216.0 / 280896.0 * samplesPerFrame);
+    }
+
+    // Each profile gives the console's controls (parameter IDs, nullptr for a setting the console fixes), sample rate
+    // table, the range of bit depths and DPCM slope bit depths it supports, and the encodings its mode parameter chooses between
+    struct NES
+    {
+        static constexpr Console console{ Console::NES };
+
+        static constexpr const char* bitDepthID{ "NESBitDepth" };
+        static constexpr const char* sampleRateID{ "NESSampleRate" };
+        static constexpr const char* modeID{ "PCMorDPCM" };
+        static constexpr const char* slopeBitDepthID{ nullptr };    // The DMC's deltas are always 1 bit, so there's no control
+        static constexpr const char* volumeShiftID{ nullptr };
+
+        // In the same order as the NESSampleRate parameter's choices
+        static constexpr float sampleRates[] = { 4177.4f, 4696.63f, 5261.41f, 5579.22f, 6023.94f, 7044.94f, 7917.18f, 8397.01f,
+                                                 9446.63f, 11233.8f, 12595.5f, 14089.9f, 16965.4f, 21315.5f, 25191.0f, 33252.1f };
+        static constexpr int numSampleRates{ (int)(sizeof(sampleRates) / sizeof(sampleRates[0])) };
+
+        static constexpr int minBitDepth{ 1 };
+        static constexpr int maxBitDepth{ 7 };          // The DMC's output counter is 7 bits
+        static constexpr int minSlopeBitDepth{ 1 };
+        static constexpr int maxSlopeBitDepth{ 1 };
+
+        static constexpr Encoding encodings[] = { Encoding::PCM, Encoding::DPCM };
+    };
+
+    struct SNES
+    {
+        static constexpr Console console{ Console::SNES };
+
+        static constexpr const char* bitDepthID{ "SNESBitDepth" };
+        static constexpr const char* sampleRateID{ "SNESSampleRate" };
+        static constexpr const char* modeID{ "SNESMode" };
+        static constexpr const char* slopeBitDepthID{ "SNESDPCMBit" };
+        static constexpr const char* volumeShiftID{ nullptr };
+
+        // In the same order as the SNESSampleRate parameter's choices. For now just 32kHz for either index, to be changed after further research
+        static constexpr float sampleRates[] = { 32000.0f, 32000.0f };
+        static constexpr int numSampleRates{ (int)(sizeof(sampleRates) / sizeof(sampleRates[0])) };
+
+        static constexpr int minBitDepth{ 1 };
+        static constexpr int maxBitDepth{ 15 };         // The DSP works with 15 bit samples
+        static constexpr int minSlopeBitDepth{ 1 };
+        static constexpr int maxSlopeBitDepth{ 4 };     // BRR's samples are 4 bits
+
+        static constexpr Encoding encodings[] = { Encoding::DPCM, Encoding::BRR };
+    };
+
+    struct GameBoy
+    {
+        static constexpr Console console{ Console::GameBoy };
+
+        static constexpr const char* bitDepthID{ nullptr };         // Wave RAM is always 4 bits
+        static constexpr const char* sampleRateID{ "GBSampleRate" };
+        static constexpr const char* modeID{ nullptr };             // Only the wave channel plays samples
+        static constexpr const char* slopeBitDepthID{ nullptr };
+        static constexpr const char* volumeShiftID{ "GBVolume" };
+
+        // Rates from frequency register values, in the same order as the GBSampleRate parameter's choices
+        static constexpr float sampleRates[] = { getWaveChannelRate(1536), getWaveChannelRate(1664), getWaveChannelRate(1792), getWaveChannelRate(1856),
+                                                 getWaveChannelRate(1920), getWaveChannelRate(1952), getWaveChannelRate(1984) };
+        static constexpr int numSampleRates{ (int)(sizeof(sampleRates) / sizeof(sampleRates[0])) };
+
+        static constexpr int minBitDepth{ 4 };
+        static constexpr int maxBitDepth{ 4 };
+        static constexpr int minSlopeBitDepth{ 0 };
+        static constexpr int maxSlopeBitDepth{ 0 };
+
+        static constexpr Encoding encodings[] = { Encoding::WaveRAM };
+    };
+
+    struct GBA
+    {
+        static constexpr Console console{ Console::GBA };
+
+        static constexpr const char* bitDepthID{ nullptr };         // Direct Sound is always 8 bit signed PCM
+        static constexpr const char* sampleRateID{ "GBASampleRate" };
+        static constexpr const char* modeID{ nullptr };
+        static constexpr const char* slopeBitDepthID{ nullptr };
+        static constexpr const char* volumeShiftID{ nullptr };
+
+        // Mixing rates from samples per frame, in the same order as the GBASampleRate parameter's choices
+        static constexpr float sampleRates[] = { getDirectSoundRate(176), getDirectSoundRate(224), getDirectSoundRate(304), getDirectSoundRate(352),
+                                                 getDirectSoundRate(528), getDirectSoundRate(608), getDirectSoundRate(672), getDirectSoundRate(704) };
+        static constexpr int numSampleRates{ (int)(sizeof(sampleRates) / sizeof(sampleRates[0])) };
+
+        static constexpr int minBitDepth{ 8 };
+        static constexpr int maxBitDepth{ 8 };
+        static constexpr int minSlopeBitDepth{ 0 };
+        static constexpr int maxSlopeBitDepth{ 0 };
+
+        static constexpr Encoding encodings[] = { Encoding::DirectSound };
+    };
+
+    // Every console with a profile. Adding a console is a new profile added here, (the rest is worked out from the list)
+    using AllProfiles = std::tuple<NES, SNES, GameBoy, GBA>;
+
+    //==============================================================================
+    // Calls function with the profile for the console, (as an empty object of the profile's type), returning false
+    // without calling it if the console has no profile, (every console in the list has one, so only an out of range value)
+    template <typename Function>
+    bool visit(Console console, Function&& function)
+    {
+        return std::apply([&](auto... profiles) { return ((profiles.console == console && (function(profiles), true)) || ...); }, AllProfiles{});
+    }
+
+    // Calls function with every profile in turn
+    template <typename Function>
+    void forEachProfile(Function&& function)
+    {
+        std::apply([&](auto... profiles) { (function(profiles), ...); }, AllProfiles{});
+    }
+
+    inline bool isEmulated(Console console)
+    {
+        return visit(console, [](auto) {});
+    }
+
+    // Looks up a rate by parameter index, (clamped so an out of range index can't read past the table)
+    template <class Profile>
+    constexpr float getSampleRate(int index) noexcept
+    {
+        return Profile::sampleRates[index < 0 ? 0 : (index >= Profile::numSampleRates ? Profile::numSampleRates - 1 : index)];
+    }
+
+    // The encoding chosen by a mode parameter index, (clamped in the same way)
+    template <class Profile>
+    constexpr Encoding getEncoding(int index) noexcept
+    {
+        constexpr int numEncodings = (int)(sizeof(Profile::encodings) / sizeof(Profile::encodings[0]));
+        return Profile::encodings[index < 0 ? 0 : (index >= numEncodings ? numEncodings - 1 : index)];
+    }
+
+    template <class Profile>
+    constexpr bool hasEncoding(Encoding encoding) noexcept
+    {
+        for (auto profileEncoding : Profile::encodings)
+        {
+            if (profileEncoding == encoding)
+            {
+                return true;
+            }
+        }
+
+        return false;
+    }
+
+    // Whether the console can quantise with a slope bit depth, (0 meaning PCM)
+    template <class Profile>
+    constexpr bool supportsSlopeBitDepth(int slopeBitDepth) noexcept
+    {
+        return slopeBitDepth == 0 ? hasEncoding<Profile>(Encoding::PCM)
+                                  : hasEncoding<Profile>(Encoding::DPCM) && slopeBitDepth >= Profile::minSlopeBitDepth && slopeBitDepth <= Profile::maxSlopeBitDepth;
+    }
+
+    static_assert(getSampleRate<NES>(0) == 4177.4f && getSampleRate<NES>(99) == 33252.1f, "NES rate table out of order");
+    static_assert(getEncoding<SNES>(1) == Encoding::BRR && !supportsSlopeBitDepth<SNES>(0), "SNES encodings out of order");
+    static_assert(getSampleRate<GameBoy>(2) == 8192.0f, "GameBoy rate table out of order");
+    static_assert((int)(getSampleRate<GBA>(1) + 0.5f) == 13379, "GBA rate table out of order");
+}
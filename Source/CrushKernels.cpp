@@ -0,0 +1,422 @@
+/*
+  ==================================================================================
+
+    Implementation file for the low level processing kernels of a JUCE VST video
+    game sample emulation plugin. These do the per sample work of the bit crush
+    functions in the processor, working on raw blocks of samples
+
+  ==================================================================================
+*/
+
+#include "CrushKernels.h"
+#include <numeric>
+
+#if JUCE_USE_SSE_INTRINSICS
+ #include <immintrin.h>
+#endif
+
+namespace CrushKernels
+{
+    HoldSections::HoldSections(double sourceRate, double emulatedRate) noexcept
+    {
+        constexpr double maxDenominator = 4294967296.0;     // Keeps section * numerator and sample * denominator within 64 bits
+
+        if (sourceRate <= 0 || emulatedRate <= 0)
+        {
+            return;
+        }
+
+        // Scale both rates by the smallest power of 2 that makes them whole numbers, which gives the increment as an exact
+        // fraction for any float rate, (and most double ones)
+        bool exact = false;
+
+        for (int shift = 0; shift <= 32 && !exact; shift++)
+        {
+            const double scaledSource = std::ldexp(sourceRate, shift);
+            const double scaledEmulated = std::ldexp(emulatedRate, shift);
+
+            if (scaledEmulated > maxDenominator || scaledSource > maxDenominator * maxDenominator / 4)
+            {
+                break;
+            }
+
+            if (scaledSource == std::floor(scaledSource) && scaledEmulated == std::floor(scaledEmulated))
+            {
+                numerator = (juce::uint64)scaledSource;
+                denominator = (juce::uint64)scaledEmulated;
+                exact = true;
+            }
+        }
+
+        if (exact)
+        {
+            const auto divisor = std::gcd(numerator, denominator);
+            numerator /= divisor;
+            denominator /= divisor;
+        }
+        else
+        {
+            // Otherwise the nearest 32.32 fixed point increment, which is still stepped along exactly
+            denominator = (juce::uint64)maxDenominator;
+            numerator = juce::jmax((juce::uint64)1, (juce::uint64)std::llround(sourceRate / emulatedRate * maxDenominator));
+        }
+
+        wholeStep = (int)(numerator / denominator);
+        remainderStep = numerator % denominator;
+        sectionsPerSample = (double)denominator / (double)numerator;
+        fractionPerRemainder = 1.0 / (double)denominator;
+    }
+
+   #if JUCE_USE_SSE_INTRINSICS
+    // SSE version of quantiseSamplePCM for four samples at once
+    static inline __m128 quantiseFourPCM(const PCMLevels& levels, __m128 samples) noexcept
+    {
+        const __m128 signMask = _mm_set1_ps(-0.0f);
+        const __m128 infinity = _mm_set1_ps(INFINITY);
+        const __m128 minVal = _mm_set1_ps(levels.minVal);
+        const __m128 levelRange = _mm_set1_ps(levels.levelRange);
+        const __m128 lastLevel = _mm_set1_ps(levels.lastLevel);
+        const __m128i one = _mm_set1_epi32(1);
+
+        // Approximate index
+        __m128 position = _mm_mul_ps(_mm_sub_ps(samples, minVal), _mm_set1_ps(levels.levelsPerUnit));
+        position = _mm_min_ps(_mm_max_ps(position, _mm_setzero_ps()), lastLevel);
+        __m128i index = _mm_cvttps_epi32(_mm_add_ps(position, _mm_set1_ps(0.5f)));
+
+        __m128 indexBelow = _mm_cvtepi32_ps(_mm_sub_epi32(index, one));
+        __m128 indexAt = _mm_cvtepi32_ps(index);
+        __m128 indexAbove = _mm_cvtepi32_ps(_mm_add_epi32(index, one));
+
+        // Levels either side of and at the approximate index
+        __m128 levelBelow = _mm_add_ps(minVal, _mm_mul_ps(levelRange, _mm_div_ps(indexBelow, lastLevel)));
+        __m128 levelAt = _mm_add_ps(minVal, _mm_mul_ps(levelRange, _mm_div_ps(indexAt, lastLevel)));
+        __m128 levelAbove = _mm_add_ps(minVal, _mm_mul_ps(levelRange, _mm_div_ps(indexAbove, lastLevel)));
+
+        // Distances to each, with levels outside the grid never chosen
+        __m128 difBelow = _mm_andnot_ps(signMask, _mm_sub_ps(samples, levelBelow));
+        __m128 difAt = _mm_andnot_ps(signMask, _mm_sub_ps(samples, levelAt));
+        __m128 difAbove = _mm_andnot_ps(signMask, _mm_sub_ps(samples, levelAbove));
+
+        __m128 belowValid = _mm_cmpgt_ps(indexAt, _mm_setzero_ps());
+        __m128 aboveValid = _mm_cmplt_ps(indexAt, lastLevel);
+        difBelow = _mm_or_ps(_mm_and_ps(belowValid, difBelow), _mm_andnot_ps(belowValid, infinity));
+        difAbove = _mm_or_ps(_mm_and_ps(aboveValid, difAbove), _mm_andnot_ps(aboveValid, infinity));
+
+        // Keep the first of the three that is strictly closest
+        __m128 bestLevel = levelBelow;
+        __m128 bestDif = difBelow;
+
+        __m128 closer = _mm_cmplt_ps(difAt, bestDif);
+        bestLevel = _mm_or_ps(_mm_and_ps(closer, levelAt), _mm_andnot_ps(closer, bestLevel));
+        bestDif = _mm_or_ps(_mm_and_ps(closer, difAt), _mm_andnot_ps(closer, bestDif));
+
+        closer = _mm_cmplt_ps(difAbove, bestDif);
+        return _mm_or_ps(_mm_and_ps(closer, levelAbove), _mm_andnot_ps(closer, bestLevel));
+    }
+   #endif
+
+   #if defined(__AVX2__)
+    // AVX2 version of quantiseSamplePCM for eight samples at once
+    static inline __m256 quantiseEightPCM(const PCMLevels& levels, __m256 samples) noexcept
+    {
+        const __m256 signMask = _mm256_set1_ps(-0.0f);
+        const __m256 infinity = _mm256_set1_ps(INFINITY);
+        const __m256 minVal = _mm256_set1_ps(levels.minVal);
+        const __m256 levelRange = _mm256_set1_ps(levels.levelRange);
+        const __m256 lastLevel = _mm256_set1_ps(levels.lastLevel);
+        const __m256i one = _mm256_set1_epi32(1);
+
+        // Approximate index
+        __m256 position = _mm256_mul_ps(_mm256_sub_ps(samples, minVal), _mm256_set1_ps(levels.levelsPerUnit));
+        position = _mm256_min_ps(_mm256_max_ps(position, _mm256_setzero_ps()), lastLevel);
+        __m256i index = _mm256_cvttps_epi32(_mm256_add_ps(position, _mm256_set1_ps(0.5f)));
+
+        __m256 indexBelow = _mm256_cvtepi32_ps(_mm256_sub_epi32(index, one));
+        __m256 indexAt = _mm256_cvtepi32_ps(index);
+        __m256 indexAbove = _mm256_cvtepi32_ps(_mm256_add_epi32(index, one));
+
+        // Levels either side of and at the approximate index
+        __m256 levelBelow = _mm256_add_ps(minVal, _mm256_mul_ps(levelRange, _mm256_div_ps(indexBelow, lastLevel)));
+        __m256 levelAt = _mm256_add_ps(minVal, _mm256_mul_ps(levelRange, _mm256_div_ps(indexAt, lastLevel)));
+        __m256 levelAbove = _mm256_add_ps(minVal, _mm256_mul_ps(levelRange, _mm256_div_ps(indexAbove, lastLevel)));
+
+        // Distances to each, with levels outside the grid never chosen
+        __m256 difBelow = _mm256_andnot_ps(signMask, _mm256_sub_ps(samples, levelBelow));
+        __m256 difAt = _mm256_andnot_ps(signMask, _mm256_sub_ps(samples, levelAt));
+        __m256 difAbove = _mm256_andnot_ps(signMask, _mm256_sub_ps(samples, levelAbove));
+
+        difBelow = _mm256_blendv_ps(infinity, difBelow, _mm256_cmp_ps(indexAt, _mm256_setzero_ps(), _CMP_GT_OQ));
+        difAbove = _mm256_blendv_ps(infinity, difAbove, _mm256_cmp_ps(indexAt, lastLevel, _CMP_LT_OQ));
+
+        // Keep the first of the three that is strictly closest
+        __m256 closer = _mm256_cmp_ps(difAt, difBelow, _CMP_LT_OQ);
+        __m256 bestLevel = _mm256_blendv_ps(levelBelow, levelAt, closer);
+        __m256 bestDif = _mm256_blendv_ps(difBelow, difAt, closer);
+
+        closer = _mm256_cmp_ps(difAbove, bestDif, _CMP_LT_OQ);
+        return _mm256_blendv_ps(bestLevel, levelAbove, closer);
+    }
+   #endif
+
+    //==============================================================================
+    void getHoldValues(const float* data, int numSamples, const HoldSections& sections, int numSections, float* values) noexcept
+    {
+        HoldSections::Position position;
+
+        for (int i = 0; i < numSections; i++, sections.advance(position))
+        {
+            // The sample after is clamped to the end of the data for the last section
+            const float before = data[position.sample];
+            const float after = data[juce::jmin(position.sample + 1, numSamples - 1)];
+            values[i] = before + sections.getFraction(position) * (after - before);
+        }
+    }
+
+    int getBlockHoldValues(const float* block, int blockStart, int numBlockSamples, bool isLastBlock, const HoldSections& sections,
+                           HoldSections::Position& position, float* values) noexcept
+    {
+        const int blockEnd = blockStart + numBlockSamples;
+        int numValues = 0;
+
+        // A section starting between the block's last sample and the next block's first is done here, as the sample after is
+        // read along with the block, (or clamped to the last sample of the data for the last block, as in getHoldValues)
+        while (isLastBlock ? sections.getStart(position) < blockEnd : position.sample < blockEnd)
+        {
+            const int offset = position.sample - blockStart;
+            const float before = block[offset];
+            const float after = block[isLastBlock ? juce::jmin(offset + 1, numBlockSamples - 1) : offset + 1];
+
+            values[numValues++] = before + sections.getFraction(position) * (after - before);
+            sections.advance(position);
+        }
+
+        return numValues;
+    }
+
+    void fillHoldSections(float* data, int numSamples, const HoldSections& sections, int numSections, const float* values) noexcept
+    {
+        HoldSections::Position position;
+        int start = 0;
+
+        for (int i = 0; i < numSections; i++)
+        {
+            sections.advance(position);
+
+            const int end = i + 1 < numSections ? sections.getStart(position) : numSamples;
+            juce::FloatVectorOperations::fill(data + start, values[i], end - start);
+            start = end;
+        }
+    }
+
+    //==============================================================================
+    float getNormaliseGain(const juce::Range<float>* channelLevels, int numChannels) noexcept
+    {
+        float peak = 0;
+
+        for (int channel = 0; channel < numChannels; channel++)
+        {
+            peak = juce::jmax(peak, std::abs(channelLevels[channel].getStart()), std::abs(channelLevels[channel].getEnd()));
+        }
+
+        return peak > 0 ? 1.0f / peak : 0.0f;
+    }
+
+    //==============================================================================
+    void quantisePCM(float* data, int numSamples, int bitDepth)
+    {
+        const PCMLevels levels(bitDepth);
+        int i = 0;
+
+       #if defined(__AVX2__)
+        for (; i + 8 <= numSamples; i += 8)
+        {
+            _mm256_storeu_ps(data + i, quantiseEightPCM(levels, _mm256_loadu_ps(data + i)));
+        }
+       #endif
+
+       #if JUCE_USE_SSE_INTRINSICS
+        for (; i + 4 <= numSamples; i += 4)
+        {
+            _mm_storeu_ps(data + i, quantiseFourPCM(levels, _mm_loadu_ps(data + i)));
+        }
+       #endif
+
+        // Scalar fallback, (and whatever is left over after the vector loops)
+        for (; i < numSamples; i++)
+        {
+            data[i] = quantiseSamplePCM(levels, data[i]);
+        }
+    }
+
+    //==============================================================================
+    void encodeDPCM(float* data, int numSamples, const HoldSections& sections, int numCodes, int bitDepth, int slopeBitDepth, float* scratch)
+    {
+        if (numCodes <= 0 || numSamples <= 0)
+        {
+            return;
+        }
+
+        // Each emulated sample's value is the first data sample of its section, which is stepped towards then overwritten
+        // with the level reached in the same scratch storage
+        HoldSections::Position position;
+
+        for (int i = 0; i < numCodes; i++, sections.advance(position))
+        {
+            scratch[i] = data[juce::jmin(sections.getStart(position), numSamples - 1)];
+        }
+
+        const PCMLevels levels(bitDepth);
+        int index = -1;
+        forEachDPCMIndex(scratch, numCodes, levels, DPCMSteps(slopeBitDepth), index, [&](int i, int index) { scratch[i] = levels.getLevel(index); });
+
+        // Expand each calculated value back over the source rate samples it covers
+        fillHoldSections(data, numSamples, sections, juce::jmin(numCodes, sections.getNumSections(numSamples)), scratch);
+    }
+
+    //==============================================================================
+    template <typename CodeType>
+    void encodeLevelCodes(const float* values, int numCodes, int bitDepth, int slopeBitDepth, CodeType* codes, int& DPCMIndex)
+    {
+        if (numCodes <= 0)
+        {
+            return;
+        }
+
+        const PCMLevels levels(bitDepth);
+
+        if (slopeBitDepth > 0)
+        {
+            forEachDPCMIndex(values, numCodes, levels, DPCMSteps(slopeBitDepth), DPCMIndex, [&](int i, int index) { codes[i] = (CodeType)index; });
+            return;
+        }
+
+        for (int i = 0; i < numCodes; i++)
+        {
+            codes[i] = (CodeType)quantiseIndexPCM(levels, values[i]);
+        }
+    }
+
+    template void encodeLevelCodes<juce::uint8>(const float*, int, int, int, juce::uint8*, int&);
+    template void encodeLevelCodes<juce::uint16>(const float*, int, int, int, juce::uint16*, int&);
+
+    //==============================================================================
+    // One bit of DMC, choosing whichever direction moves the counter towards the target level, then applying it as the hardware would
+    static inline int encodeDMCBit(float target, int& counter) noexcept
+    {
+        const int bit = target > (float)counter ? 1 : 0;
+        const int next = counter + 4 * bit - 2;
+
+        counter = (next >= 0 && next <= 127) ? next : counter;
+        return bit;
+    }
+
+    int encodeDMC(const float* data, int numSamples, int counter, juce::uint8* bytes)
+    {
+        constexpr float levelsPerUnit = 63.5f;  // Maps -1 to 1 onto the counter's 0 to 127
+        const int numWholeBytes = numSamples / 8;
+
+        // Eight samples make each byte, with the bit loop unrolled so each byte is built up in a register and stored once
+        for (int byte = 0; byte < numWholeBytes; byte++)
+        {
+            const float* samples = data + byte * 8;
+            int packed = 0;
+
+            packed |= encodeDMCBit((samples[0] + 1.0f) * levelsPerUnit, counter);
+            packed |= encodeDMCBit((samples[1] + 1.0f) * levelsPerUnit, counter) << 1;
+            packed |= encodeDMCBit((samples[2] + 1.0f) * levelsPerUnit, counter) << 2;
+            packed |= encodeDMCBit((samples[3] + 1.0f) * levelsPerUnit, counter) << 3;
+            packed |= encodeDMCBit((samples[4] + 1.0f) * levelsPerUnit, counter) << 4;
+            packed |= encodeDMCBit((samples[5] + 1.0f) * levelsPerUnit, counter) << 5;
+            packed |= encodeDMCBit((samples[6] + 1.0f) * levelsPerUnit, counter) << 6;
+            packed |= encodeDMCBit((samples[7] + 1.0f) * levelsPerUnit, counter) << 7;
+
+            bytes[byte] = (juce::uint8)packed;
+        }
+
+        // Whatever is left over goes in a final byte, filled out with alternating bits so the level stays where it is
+        const int numLeftOver = numSamples - numWholeBytes * 8;
+
+        if (numLeftOver > 0)
+        {
+            int packed = 0;
+
+            for (int bit = 0; bit < 8; bit++)
+            {
+                int value = bit < numLeftOver ? encodeDMCBit((data[numWholeBytes * 8 + bit] + 1.0f) * levelsPerUnit, counter) : (bit & 1);
+                packed |= value << bit;
+            }
+
+            bytes[numWholeBytes] = (juce::uint8)packed;
+        }
+
+        return counter;
+    }
+
+    //==============================================================================
+    // Taps of a 55 tap half band low pass, (a Kaiser windowed sinc with beta 7, scaled for unity gain at DC). Every even tap
+    // apart from the centre one (0.5) is 0, so only the odd taps either side of it are kept, nearest first. It passes up to
+    // 0.2 of the sample rate to within 0.002 dB, and is over 70 dB down from 0.3 of it
+    static constexpr float halfBandTaps[] = { 0.316902504f, -0.101933542f, 0.0569188039f, -0.0364497577f, 0.0244400508f, -0.0165318318f,
+                                              0.0110481955f, -0.00718530182f, 0.00448459461f, -0.00264344314f, 0.00143917147f,
+                                              -0.000697193212f, 0.000277677319f, -6.99278945e-05f };
+    static constexpr int numHalfBandTaps{ (int)(sizeof(halfBandTaps) / sizeof(halfBandTaps[0])) };
+    static_assert(halfBandReach == 2 * numHalfBandTaps - 1, "The half band filter's reach doesn't match its taps");
+
+    void halveSampleRateBlock(const float* source, int numOutputs, float* destination) noexcept
+    {
+        // Each output sample is the filter centred on the source sample under it
+        for (int i = 0; i < numOutputs; i++)
+        {
+            const float* centre = source + 2 * i;
+            float sum = 0.5f * centre[0];
+
+            for (int tap = 0; tap < numHalfBandTaps; tap++)
+            {
+                const int offset = 2 * tap + 1;
+                sum += halfBandTaps[tap] * (centre[-offset] + centre[offset]);
+            }
+
+            destination[i] = sum;
+        }
+    }
+
+    int halveSampleRate(const float* source, int sourceLength, float* destination)
+    {
+        const int destinationLength = (sourceLength + 1) / 2;
+
+        // Outputs whose filter stays within the data are done in one block, with no bounds checks
+        const int firstInterior = juce::jmin(destinationLength, (halfBandReach + 1) / 2);
+        const int endInterior = juce::jlimit(firstInterior, destinationLength, (sourceLength - halfBandReach + 1) / 2);
+
+        halveSampleRateBlock(source + 2 * firstInterior, endInterior - firstInterior, destination + firstInterior);
+
+        // Only those near either end are left, which treat anything outside the data as silence
+        auto filterNearEnd = [&](int i)
+        {
+            const int centre = 2 * i;
+            float sum = 0.5f * source[centre];
+
+            for (int tap = 0; tap < numHalfBandTaps; tap++)
+            {
+                const int offset = 2 * tap + 1;
+                const float before = centre - offset >= 0 ? source[centre - offset] : 0.0f;
+                const float after = centre + offset < sourceLength ? source[centre + offset] : 0.0f;
+                sum += halfBandTaps[tap] * (before + after);
+            }
+
+            destination[i] = sum;
+        };
+
+        for (int i = 0; i < firstInterior; i++)
+        {
+            filterNearEnd(i);
+        }
+
+        for (int i = endInterior; i < destinationLength; i++)
+        {
+            filterNearEnd(i);
+        }
+
+        return destinationLength;
+    }
+}
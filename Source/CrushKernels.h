@@ -0,0 +1,334 @@
+/*
+  ==================================================================================
+
+    Header file for the low level processing kernels of a JUCE VST video game
+    sample emulation plugin. These do the per sample work of the bit crush
+    functions in the processor, working on raw blocks of samples
+
+  ==================================================================================
+*/
+
+#pragma once
+
+#include <JuceHeader.h>
+
+namespace CrushKernels
+{
+    // The sections the sample rate conversion holds each emulated sample's value over. Section i starts at the first
+    // sample at or after i * increment, (the increment being the number of samples per emulated sample). The increment
+    // is kept as an exact fraction, so every boundary is exact however long the data is, and the same on every platform,
+    // rather than drifting as adding a floating point increment up would
+    struct HoldSections
+    {
+        // Sections of data at sourceRate held at emulatedRate
+        HoldSections(double sourceRate, double emulatedRate) noexcept;
+
+        // First sample of a section, (a division, so loops over every section step a position along instead)
+        int getStart(int section) const noexcept
+        {
+            return (int)(((juce::uint64)section * numerator + denominator - 1) / denominator);
+        }
+
+        // Section a sample falls in, (the last one starting at or before it). Guessed in floating point, then corrected
+        // exactly, so there's no division
+        int getSection(juce::int64 sample) const noexcept
+        {
+            auto section = (juce::int64)((double)sample * sectionsPerSample);
+            const auto scaledSample = (juce::uint64)sample * denominator;
+
+            section += (juce::uint64)(section + 1) * numerator <= scaledSample;
+            section -= section > 0 && (juce::uint64)section * numerator > scaledSample;
+            return (int)section;
+        }
+
+        // Number of sections starting within numSamples samples
+        int getNumSections(int numSamples) const noexcept   { return numSamples > 0 ? getSection(numSamples - 1) + 1 : 0; }
+
+        double getIncrement() const noexcept                { return (double)numerator / (double)denominator; }
+
+        // Where a section starts, stepped along one section at a time as a whole number of samples and an exact remainder
+        struct Position
+        {
+            int sample = 0;                 // Sample at or before the start position
+            juce::uint64 remainder = 0;     // How far past that sample the position is, in 1 / denominator of a sample
+        };
+
+        // Where a section starts, (a division, so only for the first section of a loop)
+        Position getPosition(int section) const noexcept
+        {
+            const auto scaled = (juce::uint64)section * numerator;
+            return { (int)(scaled / denominator), scaled % denominator };
+        }
+
+        void advance(Position& position) const noexcept
+        {
+            position.sample += wholeStep;
+            position.remainder += remainderStep;
+
+            if (position.remainder >= denominator)
+            {
+                position.remainder -= denominator;
+                position.sample++;
+            }
+        }
+
+        // First sample of the section
+        int getStart(const Position& position) const noexcept      { return position.sample + (position.remainder != 0 ? 1 : 0); }
+
+        // How far between the samples either side the start position is
+        float getFraction(const Position& position) const noexcept { return (float)((double)position.remainder * fractionPerRemainder); }
+
+        juce::uint64 numerator = 1;         // The increment is numerator / denominator, exactly
+        juce::uint64 denominator = 1;
+        int wholeStep = 1;                  // Whole samples in the increment
+        juce::uint64 remainderStep = 0;     // What is left of the increment, in 1 / denominator of a sample
+        double sectionsPerSample = 1;       // The inverse of the increment, for guessing a sample's section
+        double fractionPerRemainder = 1;    // 1 / denominator
+    };
+
+    // The discrete PCM levels for a bit depth. Level i is minVal + (maxVal - minVal) * (i / (numLevels - 1)), worked
+    // out with exactly the same float operations as the original level grid so every path gives bit-identical output
+    struct PCMLevels
+    {
+        constexpr explicit PCMLevels(int bitDepth)
+            : numLevels((float)(1 << bitDepth)),
+              minVal((float)(-1 + 1 / (0.5 * numLevels))),
+              levelRange(maxVal - minVal),
+              lastLevel(numLevels - 1),
+              levelsPerUnit(lastLevel / levelRange)
+        {
+        }
+
+        float getLevel(int index) const noexcept
+        {
+            return minVal + levelRange * ((float)index / lastLevel);
+        }
+
+        // Index of the level at 0, where DPCM starts from
+        int getZeroIndex() const noexcept
+        {
+            return (int)(numLevels / 2) - 1;
+        }
+
+        // Index of the level nearest to the sample, (may be one out due to rounding, which is corrected afterwards)
+        int getApproximateIndex(float sample) const noexcept
+        {
+            float position = juce::jlimit(0.0f, lastLevel, (sample - minVal) * levelsPerUnit);
+            return (int)(position + 0.5f);
+        }
+
+        float maxVal = 1.0f;    // Highest level, (declared first as the others are worked out from it)
+        float numLevels;        // Number of discrete amplitude values
+        float minVal;           // Lowest level
+        float levelRange;       // Distance from lowest to highest level
+        float lastLevel;        // Index of the highest level
+        float levelsPerUnit;    // Number of level steps per unit of amplitude
+    };
+
+    // Finds the index of the nearest level by checking either side of the approximate index, keeping the lowest level on a tie
+    inline int quantiseIndexPCM(const PCMLevels& levels, float sample) noexcept
+    {
+        int index = levels.getApproximateIndex(sample);
+
+        int bestIndex = index - 1;
+        float bestDif = index > 0 ? std::abs(sample - levels.getLevel(index - 1)) : INFINITY;
+
+        float dif = std::abs(sample - levels.getLevel(index));
+        if (dif < bestDif)
+        {
+            bestDif = dif;
+            bestIndex = index;
+        }
+
+        dif = index < (int)levels.lastLevel ? std::abs(sample - levels.getLevel(index + 1)) : INFINITY;
+        if (dif < bestDif)
+        {
+            bestIndex = index + 1;
+        }
+
+        return bestIndex;
+    }
+
+    // Finds the nearest level, (as quantiseIndexPCM)
+    inline float quantiseSamplePCM(const PCMLevels& levels, float sample) noexcept
+    {
+        return levels.getLevel(quantiseIndexPCM(levels, sample));
+    }
+
+    // The changes in level allowed from one DPCM sample to the next, precomputed for a slope bit depth. The allowed
+    // changes are every whole number of levels from -maxStep to maxStep apart from 0
+    struct DPCMSteps
+    {
+        constexpr explicit DPCMSteps(int slopeBitDepth)
+            : maxStep((1 << slopeBitDepth) / 2)
+        {
+        }
+
+        // Change in level that gets closest to the target level without leaving the grid, (lastIndex is the highest level)
+        int getChange(int index, int targetIndex, bool targetIsAbove, int lastIndex) const noexcept
+        {
+            int change = juce::jlimit(-maxStep, maxStep, targetIndex - index);
+
+            // Staying on the same level isn't possible, so step towards the target unless that would leave the grid
+            int nudge = targetIsAbove ? 1 : -1;
+            nudge = index == 0 ? 1 : nudge;
+            nudge = index == lastIndex ? -1 : nudge;
+
+            return change + (change == 0) * nudge;
+        }
+
+        int maxStep;    // Largest change in level allowed
+    };
+
+    // Works out the DPCM level index of each of the numCodes emulated samples from its value, (one per hold section), calling
+    // output(i, index) for each. The first emulated sample of the data is 0, then each following one steps from the one before
+    // towards its value. index is the last emulated sample's level index, (-1 before the first), so the data can be worked
+    // through a block at a time
+    template <typename Output>
+    inline void forEachDPCMIndex(const float* values, int numCodes, const PCMLevels& levels, const DPCMSteps& steps, int& index, Output&& output) noexcept
+    {
+        const int lastIndex = (int)levels.lastLevel;
+        int i = 0;
+
+        if (index < 0 && numCodes > 0)
+        {
+            index = levels.getZeroIndex();
+            output(i++, index);
+        }
+
+        for (; i < numCodes; i++)
+        {
+            float target = values[i];
+            float current = levels.getLevel(index);
+
+            index += steps.getChange(index, quantiseIndexPCM(levels, target), target > current, lastIndex);
+            output(i, index);
+        }
+    }
+
+    //==============================================================================
+    // The value each of the numSections sections holds, (the data at the section's start position, with a straight line
+    // between the samples either side), written to values. Kept apart from the fill so the values are all read from the
+    // original data before any of it is overwritten
+    void getHoldValues(const float* data, int numSamples, const HoldSections& sections, int numSections, float* values) noexcept;
+
+    // As getHoldValues, for data worked through a block at a time. The block holds numBlockSamples samples from blockStart,
+    // and one more, (the next block's first), unless it is the last block. Works out the value of each section from position
+    // up to the last whose start is before the next block's first sample, stepping position along, and returns how many
+    int getBlockHoldValues(const float* block, int blockStart, int numBlockSamples, bool isLastBlock, const HoldSections& sections,
+                           HoldSections::Position& position, float* values) noexcept;
+
+    // Fills each of the numSections sections of the data with its value, in place, one vectorised block write per section
+    void fillHoldSections(float* data, int numSamples, const HoldSections& sections, int numSections, const float* values) noexcept;
+
+    // Expands numSections held levels, (getLevel(section) giving each one), over numSamples samples of data, writing the range
+    // of numSamplesToExpand from startSample to destination, with silence for any part of the range outside the data. Only
+    // the sections the range covers are asked for, so a caller holding just those can expand any window of a long sample
+    template <typename LevelFunction>
+    void expandSections(const HoldSections& sections, int numSections, int numSamples, int startSample, int numSamplesToExpand,
+                        float* destination, LevelFunction&& getLevel) noexcept
+    {
+        const int endSample = startSample + numSamplesToExpand;
+        const int dataStart = juce::jlimit(startSample, endSample, 0);
+        const int dataEnd = juce::jlimit(dataStart, endSample, numSamples);
+
+        juce::FloatVectorOperations::clear(destination, dataStart - startSample);
+        juce::FloatVectorOperations::clear(destination + (dataEnd - startSample), endSample - dataEnd);
+
+        if (dataStart == dataEnd || numSections <= 0)
+        {
+            return;
+        }
+
+        // Fill each section's level over the samples it covers, the last section running on to the end of the data
+        int section = juce::jmin(sections.getSection(dataStart), numSections - 1);
+        auto position = sections.getPosition(section);
+
+        for (int start = dataStart; start < dataEnd; section++)
+        {
+            int end = dataEnd;
+
+            if (section + 1 < numSections)
+            {
+                sections.advance(position);
+                end = juce::jlimit(start, dataEnd, sections.getStart(position));
+            }
+
+            juce::FloatVectorOperations::fill(destination + (start - startSample), getLevel(section), end - start);
+            start = end;
+        }
+    }
+
+    //==============================================================================
+    // Gain which normalises data whose channels span the given ranges of levels, so its loudest point across every channel
+    // (above or below 0) reaches 1, keeping the balance between channels. The in-memory and streamed renders both take their
+    // gain from here, so a sample is crushed at the same level whichever side of the length limit it falls. 0 for silence
+    float getNormaliseGain(const juce::Range<float>* channelLevels, int numChannels) noexcept;
+
+    //==============================================================================
+    // Rounds every sample to the nearest of the 2^bitDepth discrete PCM levels, in place. The levels are the same as
+    // the original level grid (evenly spaced from -1 + 2/2^bitDepth up to 1), and ties go to the lower level as before,
+    // but the nearest level is calculated directly so the cost doesn't depend on the bit depth
+    void quantisePCM(float* data, int numSamples, int bitDepth);
+
+    // Encodes the data (already converted to the emulated sample rate over the hold sections) as DPCM, where each emulated sample can only move up or down by 1 to 2^slopeBitDepth / 2 levels of the
+    // PCM level grid from the one before. numCodes values are calculated into the caller's scratch storage (which
+    // must hold at least numCodes floats) and then expanded back over the data, in place. Nothing is allocated
+    void encodeDPCM(float* data, int numSamples, const HoldSections& sections, int numCodes, int bitDepth, int slopeBitDepth, float* scratch);
+
+    // As quantisePCM and encodeDPCM, but works from the value of each emulated sample (one per hold section, as getHoldValues
+    // gives them) and writes the index of its level to codes, rather than writing the levels back over data at the source
+    // rate. A slopeBitDepth of 0 means PCM. CodeType is juce::uint8 for bit depths up to 8, and juce::uint16 above. DPCMIndex
+    // carries the DPCM state on from the codes before, (-1 before the first code), as in forEachDPCMIndex
+    template <typename CodeType>
+    void encodeLevelCodes(const float* values, int numCodes, int bitDepth, int slopeBitDepth, CodeType* codes, int& DPCMIndex);
+
+    // As encodeLevelCodes, but with the bit depth and slope bit depth fixed at compile time, so the level grid and the
+    // allowed steps are constants in the loop. Made for each setting a console supports by its crush pipeline
+    template <int bitDepth, int slopeBitDepth, typename CodeType>
+    void encodeLevelCodesFixed(const float* values, int numCodes, CodeType* codes, int& DPCMIndex) noexcept
+    {
+        static_assert(bitDepth >= 1 && bitDepth <= (int)sizeof(CodeType) * 8, "Codes too narrow for the bit depth");
+
+        static constexpr PCMLevels levels{ bitDepth };
+        static constexpr DPCMSteps steps{ slopeBitDepth > 0 ? slopeBitDepth : 1 };
+
+        if (numCodes <= 0)
+        {
+            return;
+        }
+
+        if constexpr (slopeBitDepth > 0)
+        {
+            forEachDPCMIndex(values, numCodes, levels, steps, DPCMIndex, [codes](int i, int index) { codes[i] = (CodeType)index; });
+        }
+        else
+        {
+            for (int i = 0; i < numCodes; i++)
+            {
+                codes[i] = (CodeType)quantiseIndexPCM(levels, values[i]);
+            }
+        }
+    }
+
+    // Encodes the data (already at the DMC sample rate, and normalised to -1 to 1) as the NES delta modulation
+    // channel's 1 bit deltas, packed 8 to a byte with the first sample in the lowest bit as the hardware reads them.
+    // Each bit moves the 7 bit output counter up (1) or down (0) by 2, and is ignored by the hardware if that would
+    // take the counter outside 0 to 127, so the encoder clamps in the same way. Writes (numSamples + 7) / 8 bytes,
+    // padding the last byte with alternating bits, and returns the counter's final value
+    int encodeDMC(const float* data, int numSamples, int counter, juce::uint8* bytes);
+
+    // Low pass filters the data with a half band filter and keeps every other sample, so it plays an octave up at the same
+    // sample rate with next to no aliasing, (anything above 0.3 of the sample rate, which would fold back below the new
+    // Nyquist, is at least 70 dB down). The destination must hold at least (sourceLength + 1) / 2 floats, and the new
+    // length is returned
+    int halveSampleRate(const float* source, int sourceLength, float* destination);
+
+    // Furthest source sample either side of the one under an output sample that the half band filter reads
+    constexpr int halfBandReach{ 27 };
+
+    // As halveSampleRate, for data worked through a block at a time. Writes numOutputs samples, where source points at the
+    // source sample under the first of them, and the halfBandReach samples before it and after source[2 * (numOutputs - 1)]
+    // must all be readable, (silence for any outside the data)
+    void halveSampleRateBlock(const float* source, int numOutputs, float* destination) noexcept;
+}
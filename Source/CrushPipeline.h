@@ -0,0 +1,112 @@
+/*
+  ==================================================================================
+
+    Header file for the per console crush pipeline of a JUCE VST video game sample
+    emulation plugin. The quantise kernels are instantiated for every bit depth
+    and slope bit depth a console supports, with the console's profile deciding
+    which, so each loop is compiled with its level grid and step sizes as constants
+
+  ==================================================================================
+*/
+
+#pragma once
+
+#include <JuceHeader.h>
+#include "ConsoleProfiles.h"
+#include "CrushKernels.h"
+#include "LevelCodes.h"
+#include "WaveRAMFrames.h"
+#include "Parameters.h"
+
+//==============================================================================
+/**
+    The crush pipeline for one console. Runtime settings are looked up in a table
+    of kernels made at compile time from the profile's limits, so choosing the
+    kernel is one index rather than a chain of branches, and a setting the console
+    doesn't have has no kernel made for it at all.
+*/
+template <class Profile>
+class CrushPipeline
+{
+public:
+    // Stores the settings of the console's controls in the parameters, clamped to what the console supports
+    static void setParameters(Parameters& params, int modeIndex, int bitDepth, int rateIndex, int slopeBitDepth, int volumeShift) noexcept
+    {
+        const auto encoding = ConsoleProfiles::getEncoding<Profile>(modeIndex);
+
+        params.DPCM = encoding == ConsoleProfiles::Encoding::DPCM || encoding == ConsoleProfiles::Encoding::BRR;
+        params.BRR = encoding == ConsoleProfiles::Encoding::BRR;
+        params.waveRAM = encoding == ConsoleProfiles::Encoding::WaveRAM;
+        params.directSound = encoding == ConsoleProfiles::Encoding::DirectSound;
+        params.volumeShift = juce::jlimit(0, WaveRAMFrames::numVolumeShifts - 1, volumeShift);
+        params.bitDepth = juce::jlimit(Profile::minBitDepth, Profile::maxBitDepth, bitDepth);
+        params.DPCMBit = juce::jlimit(Profile::minSlopeBitDepth, Profile::maxSlopeBitDepth, slopeBitDepth);
+        params.sampleRate = ConsoleProfiles::getSampleRate<Profile>(rateIndex);
+    }
+
+    // Quantises numCodes emulated sample values (one per code, already resampled and normalised) to codes, through the kernel
+    // made for the bit depth and slope bit depth, (0 meaning PCM). Returns false if the console has no such setting, or
+    // CodeType isn't the code width the bit depth needs, (juce::uint8 up to 8 bits, juce::uint16 above), so the caller can
+    // use the general kernel instead. DPCMIndex carries the DPCM state between calls, as in CrushKernels::forEachDPCMIndex
+    template <typename CodeType>
+    static bool quantiseChannel(const float* values, int numCodes, int bitDepth, int slopeBitDepth, CodeType* codes, int& DPCMIndex) noexcept
+    {
+        // Every kernel, indexed by bit depth then slope bit depth, (worked out at compile time)
+        static constexpr std::array<Kernel<CodeType>, (size_t)(numBitDepths * numSlopes)> kernels{ makeKernels<CodeType>(std::make_integer_sequence<int, numBitDepths * numSlopes>{}) };
+
+        if (bitDepth < Profile::minBitDepth || bitDepth > Profile::maxBitDepth || slopeBitDepth < 0 || slopeBitDepth >= numSlopes)
+        {
+            return false;
+        }
+
+        auto kernel = kernels[(size_t)((bitDepth - Profile::minBitDepth) * numSlopes + slopeBitDepth)];
+
+        if (kernel == nullptr)
+        {
+            return false;
+        }
+
+        kernel(values, numCodes, codes, DPCMIndex);
+        return true;
+    }
+
+    // As above, but quantises the whole of one channel of the codes, (which must have been made with the same bit depth)
+    static bool quantiseChannel(const float* values, int bitDepth, int slopeBitDepth, LevelCodes& codes, int channel) noexcept
+    {
+        int DPCMIndex = -1;
+
+        return codes.hasEightBitCodes() ? quantiseChannel(values, codes.getNumCodes(), bitDepth, slopeBitDepth, codes.getEightBitCodes(channel), DPCMIndex)
+                                        : quantiseChannel(values, codes.getNumCodes(), bitDepth, slopeBitDepth, codes.getSixteenBitCodes(channel), DPCMIndex);
+    }
+
+private:
+    template <typename CodeType>
+    using Kernel = void (*)(const float*, int, CodeType*, int&);
+
+    static constexpr int numBitDepths{ Profile::maxBitDepth - Profile::minBitDepth + 1 };
+    static constexpr int numSlopes{ Profile::maxSlopeBitDepth + 1 };   // Slope bit depths from 0 (PCM) up, whether or not the console has them
+
+    // The kernel for an entry of the table, (nullptr for a setting the console doesn't have, or a code width that doesn't fit it)
+    template <typename CodeType, int index>
+    static constexpr Kernel<CodeType> makeKernel() noexcept
+    {
+        constexpr int bitDepth = Profile::minBitDepth + index / numSlopes;
+        constexpr int slopeBitDepth = index % numSlopes;
+        constexpr bool eightBitCodes = bitDepth <= 8;
+
+        if constexpr (ConsoleProfiles::supportsSlopeBitDepth<Profile>(slopeBitDepth) && eightBitCodes == std::is_same_v<CodeType, juce::uint8>)
+        {
+            return &CrushKernels::encodeLevelCodesFixed<bitDepth, slopeBitDepth, CodeType>;
+        }
+        else
+        {
+            return nullptr;
+        }
+    }
+
+    template <typename CodeType, int... indices>
+    static constexpr std::array<Kernel<CodeType>, sizeof...(indices)> makeKernels(std::integer_sequence<int, indices...>) noexcept
+    {
+        return { { makeKernel<CodeType, indices>()... } };
+    }
+};
@@ -0,0 +1,585 @@
+/*
+  ==================================================================================
+
+    Implementation file for the sound and voice used by the sampler of a JUCE VST
+    video game sample emulation plugin. The sound owns the processed (bit crushed)
+    sample data in memory, so it can be played straight away without the sample
+    having to be written to and read back from an audio file
+
+  ==================================================================================
+*/
+
+// Sound and voice functionality adapted from:
+// [3]
+/***********************************************************************************
+* Title: juce_Sampler.cpp (juce::SamplerSound and juce::SamplerVoice)
+* Author: Raw Material Software Limited
+* Date: 2020
+* Code Version: JUCE 6
+* Availability: https://github.com/juce-framework/JUCE/blob/master/modules/juce_audio_formats/sampler/juce_Sampler.cpp
+***********************************************************************************/
+
+#include "CrushedSampler.h"
+
+//==============================================================================
+CrushedSound::CrushedSound(const juce::String& soundName,
+                           std::shared_ptr<const juce::AudioBuffer<float>> sampleData,
+                           int sampleLength,
+                           double sampleRate,
+                           const juce::BigInteger& notes,
+                           int midiNoteForNormalPitch,
+                           double attackTimeSecs,
+                           double releaseTimeSecs)
+    : name(soundName),
+      data(std::move(sampleData)),
+      sourceSampleRate(sampleRate),
+      midiNotes(notes),
+      length(sampleLength),
+      midiRootNote(midiNoteForNormalPitch)
+{
+    // The voice interpolates past the final sample, so there must be some silence after it, as in [3]
+    jassert(data->getNumSamples() >= length + 4);
+
+    params.attack = static_cast<float>(attackTimeSecs);
+    params.release = static_cast<float>(releaseTimeSecs);
+}
+
+CrushedSound::CrushedSound(const juce::String& soundName,
+                           std::shared_ptr<const LevelCodes> sampleCodes,
+                           double sampleRate,
+                           const juce::BigInteger& notes,
+                           int midiNoteForNormalPitch,
+                           double attackTimeSecs,
+                           double releaseTimeSecs)
+    : name(soundName),
+      codes(std::move(sampleCodes)),
+      sourceSampleRate(sampleRate),
+      midiNotes(notes),
+      length(codes->getNumSamples()),
+      midiRootNote(midiNoteForNormalPitch)
+{
+    params.attack = static_cast<float>(attackTimeSecs);
+    params.release = static_cast<float>(releaseTimeSecs);
+}
+
+CrushedSound::CrushedSound(const juce::String& soundName,
+                           std::shared_ptr<const WaveRAMFrames> sampleFrames,
+                           double sampleRate,
+                           const juce::BigInteger& notes,
+                           int midiNoteForNormalPitch,
+                           double attackTimeSecs,
+                           double releaseTimeSecs)
+    : name(soundName),
+      waveFrames(std::move(sampleFrames)),
+      sourceSampleRate(sampleRate),
+      midiNotes(notes),
+      length(waveFrames->getNumSamples()),
+      midiRootNote(midiNoteForNormalPitch)
+{
+    params.attack = static_cast<float>(attackTimeSecs);
+    params.release = static_cast<float>(releaseTimeSecs);
+}
+
+CrushedSound::CrushedSound(const juce::String& soundName,
+                           std::shared_ptr<const DirectSoundSample> sampleDirect,
+                           double sampleRate,
+                           const juce::BigInteger& notes,
+                           int midiNoteForNormalPitch,
+                           double attackTimeSecs,
+                           double releaseTimeSecs)
+    : name(soundName),
+      directSample(std::move(sampleDirect)),
+      sourceSampleRate(sampleRate),
+      midiNotes(notes),
+      length(directSample->getNumSamples()),
+      midiRootNote(midiNoteForNormalPitch)
+{
+    params.attack = static_cast<float>(attackTimeSecs);
+    params.release = static_cast<float>(releaseTimeSecs);
+}
+
+size_t CrushedSound::getPitchVariantBytes() const noexcept
+{
+    size_t numBytes = 0;
+
+    if (pitchVariants != nullptr)
+    {
+        for (auto& variant : *pitchVariants)
+        {
+            numBytes += (size_t)variant.data->getNumChannels() * (size_t)variant.data->getNumSamples() * sizeof(float);
+        }
+    }
+
+    return numBytes;
+}
+
+bool CrushedSound::appliesToNote(int midiNoteNumber)
+{
+    return midiNotes[midiNoteNumber];
+}
+
+bool CrushedSound::appliesToChannel(int /*midiChannel*/)
+{
+    return true;
+}
+
+//==============================================================================
+CrushedVoice::CrushedVoice() {}
+CrushedVoice::~CrushedVoice() {}
+
+bool CrushedVoice::canPlaySound(juce::SynthesiserSound* sound)
+{
+    // Streamed sounds can only be played by voices with a read-ahead window
+    if (auto* crushedSound = dynamic_cast<const CrushedSound*>(sound))
+    {
+        return crushedSound->streamSource == nullptr || streamRing != nullptr;
+    }
+
+    return false;
+}
+
+void CrushedVoice::startNote(int midiNoteNumber, float velocity, juce::SynthesiserSound* s, int /*currentPitchWheelPosition*/)
+{
+    if (auto* sound = dynamic_cast<const CrushedSound*>(s))
+    {
+        playingData = sound->data.get();
+        playingCodes = sound->codes.get();
+        playingWave = sound->waveFrames.get();
+        playingDirect = sound->directSample.get();
+        playingLength = sound->length;
+        double playingSampleRate = sound->sourceSampleRate;
+
+        // Play the pitch variant pre-rendered nearest to the note's octave, if there is one, so it is repitched by at most half an octave
+        const int octavesUp = juce::jmin(juce::roundToInt((midiNoteNumber - sound->midiRootNote) / 12.0), sound->getNumPitchVariants());
+
+        // For a streamed sound, play the head from the data while the rest is read into the ring from where the head ends
+        streaming = sound->streamSource != nullptr && streamRing != nullptr;
+
+        if (streaming)
+        {
+            headLength = sound->length;
+            playingLength = sound->streamSource->getLength();
+            streamRequest = streamRing->requestSource(sound->streamSource.get(), headLength);
+        }
+        else if (octavesUp > 0)
+        {
+            auto& variant = (*sound->pitchVariants)[(size_t)(octavesUp - 1)];
+            playingData = variant.data.get();
+            playingCodes = nullptr;
+            playingLength = variant.length;
+            playingSampleRate = variant.sampleRate;
+        }
+
+        // Step through the data faster or slower depending on how far the note is from the root note
+        pitchRatio = std::pow(2.0, (midiNoteNumber - sound->midiRootNote) / 12.0)
+                        * playingSampleRate / getSampleRate();
+
+        sourceSamplePosition = 0.0;
+
+        // Wave RAM frames are stepped through in fixed point, as the wave channel's timer does
+        if (playingWave != nullptr)
+        {
+            wavePhase = 0;
+            wavePhaseStep = (juce::uint64)(pitchRatio * 4294967296.0);
+            std::copy(playingWave->getOutputLevels(), playingWave->getOutputLevels() + 16, waveLevels);
+        }
+
+        // A Direct Sound sample is stepped through at the mixing rate, so the step is worked out once the mixer's rate is known
+        if (playingDirect != nullptr)
+        {
+            directNoteRate = pitchRatio * getSampleRate();
+            directMixRate = 0;
+            directPhase = 0;
+        }
+
+        lgain = velocity;
+        rgain = velocity;
+        currentLevel = velocity;
+
+        adsr.setSampleRate(getSampleRate());    // The envelope moves on once per output sample, whatever rate the data is at
+        adsr.setParameters(sound->params);
+
+        adsr.noteOn();
+    }
+    else
+    {
+        jassertfalse; // this object can only play CrushedSounds!
+    }
+}
+
+void CrushedVoice::stopNote(float /*velocity*/, bool allowTailOff)
+{
+    if (allowTailOff)
+    {
+        adsr.noteOff();
+    }
+    else
+    {
+        finishNote();
+    }
+}
+
+void CrushedVoice::finishNote()
+{
+    // Let the streamer stop reading for this voice, (before the sound is let go, so the source can't be freed while still requested)
+    if (streaming)
+    {
+        streamRing->requestSource(nullptr, 0);
+        streaming = false;
+    }
+
+    clearCurrentNote();
+    adsr.reset();
+}
+
+void CrushedVoice::pitchWheelMoved(int /*newValue*/) {}
+void CrushedVoice::controllerMoved(int /*controllerNumber*/, int /*newValue*/) {}
+
+//==============================================================================
+void CrushedVoice::renderNextBlock(juce::AudioBuffer<float>& outputBuffer, int startSample, int numSamples)
+{
+    if (getCurrentlyPlayingSound() != nullptr && (playingData != nullptr || playingCodes != nullptr || playingWave != nullptr))
+    {
+        // Level codes are read through the codes themselves, float data straight from its channels, and wave RAM frames
+        // (which are always mono) by the wave chunk renderer
+        const int numChannels = playingWave != nullptr ? 1 : (playingCodes != nullptr ? playingCodes->getNumChannels() : playingData->getNumChannels());
+        const bool stereo = numChannels > 1;
+        const float* const inL = playingData != nullptr && playingCodes == nullptr && playingWave == nullptr ? playingData->getReadPointer(0) : nullptr;
+        const float* const inR = inL != nullptr && stereo ? playingData->getReadPointer(1) : nullptr;
+
+        float* outL = outputBuffer.getWritePointer(0, startSample);
+        float* outR = outputBuffer.getNumChannels() > 1 ? outputBuffer.getWritePointer(1, startSample) : nullptr;
+
+        // The voice renders a chunk at a time into its own buffers, which are then mixed into the output in one
+        // vectorised pass per channel rather than one sample at a time
+        while (numSamples > 0)
+        {
+            const int chunkSize = juce::jmin(numSamples, renderChunkSize);
+            int numRendered = 0;
+            bool noteFinished = false;
+            float envelopeValue = 0;
+
+            // How much of a streamed sound has been read into the ring so far
+            juce::int64 streamedEnd = streaming ? streamRing->getWrittenEnd(streamRequest, headLength) : 0;
+            int numUnderruns = 0;
+
+            // A streamed sample comes from the head, then the ring, or is silent if the streamer has fallen behind
+            auto getStreamedSample = [&](const float* head, int channel, juce::int64 position) -> float
+            {
+                if (position < headLength)
+                {
+                    return head[position];
+                }
+                if (position < streamedEnd)
+                {
+                    return streamRing->getSample(channel, position);
+                }
+                numUnderruns += position < playingLength ? 1 : 0;
+                return 0.0f;
+            };
+
+            if (playingWave != nullptr)
+            {
+                numRendered = renderWaveChunk(chunkSize, envelopeValue, noteFinished);
+            }
+            else
+            {
+                while (numRendered < chunkSize)
+                {
+                    auto pos = (juce::int64)sourceSamplePosition;
+                    auto alpha = (float)(sourceSamplePosition - (double)pos);
+                    auto invAlpha = 1.0f - alpha;
+
+                    envelopeValue = adsr.getNextSample();
+
+                    // Just using a very simple linear interpolation here, as in [3]
+                    if (streaming)
+                    {
+                        chunkL[numRendered] = (getStreamedSample(inL, 0, pos) * invAlpha + getStreamedSample(inL, 0, pos + 1) * alpha) * envelopeValue;
+                        if (stereo)
+                        {
+                            chunkR[numRendered] = (getStreamedSample(inR, 1, pos) * invAlpha + getStreamedSample(inR, 1, pos + 1) * alpha) * envelopeValue;
+                        }
+                    }
+                    else if (playingCodes != nullptr)
+                    {
+                        // Expand the codes to floats here, as they are played
+                        chunkL[numRendered] = (playingCodes->getSample(0, pos) * invAlpha + playingCodes->getSample(0, pos + 1) * alpha) * envelopeValue;
+                        if (stereo)
+                        {
+                            chunkR[numRendered] = (playingCodes->getSample(1, pos) * invAlpha + playingCodes->getSample(1, pos + 1) * alpha) * envelopeValue;
+                        }
+                    }
+                    else
+                    {
+                        chunkL[numRendered] = (inL[pos] * invAlpha + inL[pos + 1] * alpha) * envelopeValue;
+                        if (stereo)
+                        {
+                            chunkR[numRendered] = (inR[pos] * invAlpha + inR[pos + 1] * alpha) * envelopeValue;
+                        }
+                    }
+
+                    numRendered++;
+                    sourceSamplePosition += pitchRatio;
+
+                    // Stop the note once the end of the data has been reached or the envelope has finished
+                    if (sourceSamplePosition > playingLength || !adsr.isActive())
+                    {
+                        noteFinished = true;
+                        break;
+                    }
+                }
+            }
+
+            // Mix the chunk into the output with the note's gain, (a mono source is sent to both channels)
+            const float* chunkRight = stereo ? chunkR : chunkL;
+
+            if (outR != nullptr)
+            {
+                juce::FloatVectorOperations::addWithMultiply(outL, chunkL, lgain, numRendered);
+                juce::FloatVectorOperations::addWithMultiply(outR, chunkRight, rgain, numRendered);
+                outR += numRendered;
+            }
+            else
+            {
+                juce::FloatVectorOperations::addWithMultiply(outL, chunkL, lgain * 0.5f, numRendered);
+                juce::FloatVectorOperations::addWithMultiply(outL, chunkRight, rgain * 0.5f, numRendered);
+            }
+
+            outL += numRendered;
+            numSamples -= numRendered;
+            currentLevel = envelopeValue * juce::jmax(lgain, rgain);
+
+            // Let the streamer refill the part of the ring that has been played
+            if (streaming)
+            {
+                streamRing->setReadPosition((juce::int64)sourceSamplePosition);
+                if (numUnderruns > 0)
+                {
+                    streamRing->addUnderruns(numUnderruns);
+                }
+            }
+
+            if (noteFinished)
+            {
+                stopNote(0.0f, false);
+                currentLevel = 0;
+                break;
+            }
+        }
+    }
+}
+
+// The wave RAM path, with no interpolation as the wave channel holds each sample until its timer steps to the next.
+// Each sample is a shift, a byte load, a nibble select and a table lookup, with no floating point position
+int CrushedVoice::renderWaveChunk(int chunkSize, float& envelopeValue, bool& noteFinished) noexcept
+{
+    const juce::uint64 endPhase = (juce::uint64)playingWave->getNumSamples() << 32;
+    int numRendered = 0;
+
+    while (numRendered < chunkSize)
+    {
+        envelopeValue = adsr.getNextSample();
+        chunkL[numRendered++] = waveLevels[playingWave->getNibble((juce::int64)(wavePhase >> 32))] * envelopeValue;
+
+        wavePhase += wavePhaseStep;
+
+        // Stop the note once the end of the frames has been reached or the envelope has finished
+        if (wavePhase >= endPhase || !adsr.isActive())
+        {
+            noteFinished = true;
+            break;
+        }
+    }
+
+    return numRendered;
+}
+
+// The Direct Sound path, run by the synthesiser's mixer at the mixing rate. The sample and volume are integers, so every
+// voice is summed exactly as the GBA's software mixer does before the sum is clipped
+void CrushedVoice::renderDirectSound(int* accumulator, int numTicks, double mixRate) noexcept
+{
+    // The envelope runs at the mixing rate too, as it is applied a tick at a time
+    if (mixRate != directMixRate)
+    {
+        directMixRate = mixRate;
+        directPhaseStep = (juce::uint64)(directNoteRate / mixRate * 4294967296.0);
+        adsr.setSampleRate(mixRate);
+    }
+
+    const juce::int8* samples = playingDirect->getData();
+    const juce::uint64 endPhase = (juce::uint64)playingDirect->getNumSamples() << 32;
+    const float gain = juce::jmax(lgain, rgain) * (float)(1 << DirectSoundMixer::volumeBits);
+    float envelopeValue = 0;
+
+    for (int tick = 0; tick < numTicks; tick++)
+    {
+        envelopeValue = adsr.getNextSample();
+        const int volume = (int)(gain * envelopeValue);     // The voice's 8 bit volume, (256 being full volume)
+
+        accumulator[tick] += samples[directPhase >> 32] * volume;
+        directPhase += directPhaseStep;
+
+        // Stop the note once the end of the sample has been reached or the envelope has finished
+        if (directPhase >= endPhase || !adsr.isActive())
+        {
+            stopNote(0.0f, false);
+            currentLevel = 0;
+            return;
+        }
+    }
+
+    currentLevel = envelopeValue * juce::jmax(lgain, rgain);
+}
+
+//==============================================================================
+CrushedSynthesiser::CrushedSynthesiser()
+{
+    sounds.ensureStorageAllocated(1);   // Allocate room for the sound up front so swapping never allocates
+}
+
+void CrushedSynthesiser::swapSound(juce::SynthesiserSound* newSound)
+{
+    const juce::ScopedLock sl(lock);
+
+    if (sounds.size() > 0)
+    {
+        sounds.set(0, newSound);
+    }
+    else
+    {
+        sounds.add(newSound);
+    }
+}
+
+void CrushedSynthesiser::setCurrentPlaybackSampleRate(double sampleRate)
+{
+    Synthesiser::setCurrentPlaybackSampleRate(sampleRate);
+    directSoundMixer.prepare(sampleRate);
+}
+
+// Adapted from juce::Synthesiser::renderVoices. Voices playing Direct Sound samples add into the mixer's accumulator a
+// chunk at a time, and each chunk is clipped and held up to the host's rate once however many voices are playing
+void CrushedSynthesiser::renderVoices(juce::AudioBuffer<float>& outputAudio, int startSample, int numSamples)
+{
+    bool anyMixed = false;
+
+    for (auto* voice : voices)
+    {
+        auto* crushedVoice = dynamic_cast<CrushedVoice*>(voice);
+
+        if (crushedVoice != nullptr && crushedVoice->isMixedByDirectSound())
+        {
+            anyMixed = true;
+        }
+        else
+        {
+            voice->renderNextBlock(outputAudio, startSample, numSamples);
+        }
+    }
+
+    // Only run the mixer while it has voices, (its output would be silence otherwise)
+    if (!anyMixed || directSoundMixer.getMixRate() <= 0)
+    {
+        directSoundMixer.reset();
+        return;
+    }
+
+    while (numSamples > 0)
+    {
+        const int chunkSize = juce::jmin(numSamples, directSoundMixer.getMaxChunkSize());
+        const int numTicks = directSoundMixer.beginChunk(chunkSize);
+
+        for (auto* voice : voices)
+        {
+            auto* crushedVoice = dynamic_cast<CrushedVoice*>(voice);
+
+            if (crushedVoice != nullptr && crushedVoice->isMixedByDirectSound())
+            {
+                crushedVoice->renderDirectSound(directSoundMixer.getAccumulator(), numTicks, directSoundMixer.getMixRate());
+            }
+        }
+
+        directSoundMixer.endChunk(outputAudio, startSample, chunkSize);
+        startSample += chunkSize;
+        numSamples -= chunkSize;
+    }
+}
+
+void CrushedSynthesiser::setVoiceLimit(int newVoiceLimit) noexcept
+{
+    voiceLimit.store(juce::jmax(1, newVoiceLimit));
+}
+
+// Adapted from juce::Synthesiser::findFreeVoice, only looking at voices within the voice limit
+juce::SynthesiserVoice* CrushedSynthesiser::findFreeVoice(juce::SynthesiserSound* soundToPlay, int midiChannel, int midiNoteNumber, bool stealIfNoneAvailable) const
+{
+    const juce::ScopedLock sl(lock);
+
+    const int numUsableVoices = juce::jmin(voiceLimit.load(), voices.size());
+
+    for (int i = 0; i < numUsableVoices; ++i)
+    {
+        auto* voice = voices.getUnchecked(i);
+
+        if (!voice->isVoiceActive() && voice->canPlaySound(soundToPlay))
+        {
+            return voice;
+        }
+    }
+
+    if (stealIfNoneAvailable)
+    {
+        return findVoiceToSteal(soundToPlay, midiChannel, midiNoteNumber);
+    }
+
+    return nullptr;
+}
+
+// Chooses which voice within the voice limit to cut off for a new note, according to the stealing policy
+juce::SynthesiserVoice* CrushedSynthesiser::findVoiceToSteal(juce::SynthesiserSound* soundToPlay, int /*midiChannel*/, int /*midiNoteNumber*/) const
+{
+    const int numUsableVoices = juce::jmin(voiceLimit.load(), voices.size());
+    const bool stealQuietest = stealingPolicy.load() == StealingPolicy::quietestVoice;
+
+    juce::SynthesiserVoice* bestVoice = nullptr;         // Best voice to steal found so far
+    bool bestVoiceIsReleased = false;                    // Whether the best voice's key has already been released
+    float bestVoiceLevel = std::numeric_limits<float>::max();  // Level of the best voice
+
+    for (int i = 0; i < numUsableVoices; ++i)
+    {
+        auto* voice = voices.getUnchecked(i);
+
+        if (!voice->canPlaySound(soundToPlay))
+        {
+            continue;
+        }
+
+        if (stealQuietest)
+        {
+            // Take the quietest voice, or the oldest of equally quiet ones
+            auto* crushedVoice = dynamic_cast<CrushedVoice*>(voice);
+            float level = crushedVoice != nullptr ? crushedVoice->getCurrentLevel() : 0.0f;
+
+            if (bestVoice == nullptr || level < bestVoiceLevel || (level == bestVoiceLevel && voice->wasStartedBefore(*bestVoice)))
+            {
+                bestVoice = voice;
+                bestVoiceLevel = level;
+            }
+        }
+        else
+        {
+            // Take the oldest note, preferring any whose key has already been released
+            bool isReleased = voice->isPlayingButReleased();
+
+            if (bestVoice == nullptr || (isReleased && !bestVoiceIsReleased)
+                || (isReleased == bestVoiceIsReleased && voice->wasStartedBefore(*bestVoice)))
+            {
+                bestVoice = voice;
+                bestVoiceIsReleased = isReleased;
+            }
+        }
+    }
+
+    return bestVoice;
+}
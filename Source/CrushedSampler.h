@@ -0,0 +1,263 @@
+/*
+  ==================================================================================
+
+    Header file for the sound and voice used by the sampler of a JUCE VST video
+    game sample emulation plugin. The sound owns the processed (bit crushed)
+    sample data in memory, so it can be played straight away without the sample
+    having to be written to and read back from an audio file
+
+  ==================================================================================
+*/
+
+// Sound and voice functionality adapted from:
+// [3]
+/***********************************************************************************
+* Title: juce_Sampler.cpp (juce::SamplerSound and juce::SamplerVoice)
+* Author: Raw Material Software Limited
+* Date: 2020
+* Code Version: JUCE 6
+* Availability: https://github.com/juce-framework/JUCE/blob/master/modules/juce_audio_formats/sampler/juce_Sampler.cpp
+***********************************************************************************/
+
+#pragma once
+
+#include <JuceHeader.h>
+#include "SampleStreamer.h"
+#include "LevelCodes.h"
+#include "WaveRAMFrames.h"
+#include "DirectSoundMixer.h"
+
+//==============================================================================
+/**
+    A sound for the sampler which holds the processed sample data in memory.
+    Adapted from [3], but built directly from an AudioBuffer rather than from an
+    AudioFormatReader. The data is shared and never changed, so sounds which only
+    differ in their root note or note range can use the same data.
+
+    A sound can also carry pitch variants, copies of the data pre-rendered an
+    octave or more up (filtered and at a lower sample rate), which the voice
+    plays instead of the main data for notes far above the root note.
+
+    A sound for a sample too long to keep in memory has a stream source, in which
+    case the data only holds the head of the sample and the rest is streamed.
+
+    A sound can instead be built from level codes, the compact form of the data
+    at the emulated sample rate, which the voice expands as it plays, or from
+    GameBoy wave RAM frames, which the voice plays through a fixed point wavetable
+    reader at the wave channel's own rate, or from a GBA Direct Sound sample, which
+    the synthesiser's Direct Sound mixer plays at the mixing rate.
+*/
+class CrushedSound : public juce::SynthesiserSound
+{
+public:
+    // The data must have at least 4 samples of silence after the first sampleLength samples, for interpolation
+    CrushedSound(const juce::String& soundName,
+                 std::shared_ptr<const juce::AudioBuffer<float>> sampleData,
+                 int sampleLength,
+                 double sampleRate,
+                 const juce::BigInteger& notes,
+                 int midiNoteForNormalPitch,
+                 double attackTimeSecs,
+                 double releaseTimeSecs);
+
+    // Built from level codes instead of float data, (the codes know how many samples of data they stand for)
+    CrushedSound(const juce::String& soundName,
+                 std::shared_ptr<const LevelCodes> sampleCodes,
+                 double sampleRate,
+                 const juce::BigInteger& notes,
+                 int midiNoteForNormalPitch,
+                 double attackTimeSecs,
+                 double releaseTimeSecs);
+
+    // Built from GameBoy wave RAM frames, which play at the wave channel's rate, (given as the sample rate)
+    CrushedSound(const juce::String& soundName,
+                 std::shared_ptr<const WaveRAMFrames> sampleFrames,
+                 double sampleRate,
+                 const juce::BigInteger& notes,
+                 int midiNoteForNormalPitch,
+                 double attackTimeSecs,
+                 double releaseTimeSecs);
+
+    // Built from a GBA Direct Sound sample, which the voices step through at the mixing rate
+    CrushedSound(const juce::String& soundName,
+                 std::shared_ptr<const DirectSoundSample> sampleDirect,
+                 double sampleRate,
+                 const juce::BigInteger& notes,
+                 int midiNoteForNormalPitch,
+                 double attackTimeSecs,
+                 double releaseTimeSecs);
+
+    using Ptr = juce::ReferenceCountedObjectPtr<CrushedSound>;
+
+    // A copy of the data pre-rendered for playing notes an octave or more above the root note
+    struct PitchVariant
+    {
+        std::shared_ptr<const juce::AudioBuffer<float>> data;   // The filtered, lower sample rate data, (with padding as for the main data)
+        int length = 0;                                         // Number of samples of actual data
+        double sampleRate = 0;                                  // Sample rate the data is played back at for the root note
+    };
+    using PitchVariantArray = std::vector<PitchVariant>;        // Variant i is pre-rendered (i + 1) octaves up
+
+    const juce::String& getName() const noexcept            { return name; }
+    const juce::AudioBuffer<float>* getAudioData() const noexcept { return data.get(); }   // (null if the sound isn't built from float data)
+    const LevelCodes* getLevelCodes() const noexcept        { return codes.get(); }       // (null if the sound isn't built from level codes)
+    const WaveRAMFrames* getWaveRAMFrames() const noexcept  { return waveFrames.get(); }  // (null if the sound isn't built from wave RAM frames)
+    const DirectSoundSample* getDirectSoundSample() const noexcept { return directSample.get(); }  // (null if the sound isn't a Direct Sound sample)
+    double getSourceSampleRate() const noexcept             { return sourceSampleRate; }
+    int getLength() const noexcept                          { return length; }
+
+    // Gives the sound its pitch variants, (only before it is handed to the sampler)
+    void setPitchVariants(std::shared_ptr<const PitchVariantArray> newPitchVariants) { pitchVariants = std::move(newPitchVariants); }
+    int getNumPitchVariants() const noexcept { return pitchVariants != nullptr ? (int)pitchVariants->size() : 0; }
+
+    // Memory used by the pitch variants' data
+    size_t getPitchVariantBytes() const noexcept;
+
+    // Makes the sound play the rest of the sample from the source after the head held in the data, (only before it is handed to the sampler)
+    void setStreamSource(StreamSource* newStreamSource) { streamSource = newStreamSource; }
+    StreamSource* getStreamSource() const noexcept { return streamSource.get(); }
+
+    bool appliesToNote(int midiNoteNumber) override;    // Whether the sound should be played for this MIDI note
+    bool appliesToChannel(int midiChannel) override;    // Whether the sound should be played for this MIDI channel
+
+private:
+    friend class CrushedVoice;
+
+    juce::String name;                  // Name of the sound
+    std::shared_ptr<const juce::AudioBuffer<float>> data;   // The processed sample data (with a few samples of padding for interpolation)
+    std::shared_ptr<const LevelCodes> codes;                // Or the processed sample as level codes, (only one of these is used)
+    std::shared_ptr<const WaveRAMFrames> waveFrames;        // Or the processed sample as wave RAM frames
+    std::shared_ptr<const DirectSoundSample> directSample;  // Or the processed sample as 8 bit signed PCM for the Direct Sound mixer
+    double sourceSampleRate;            // The sample rate the data should be played back at for its root note
+    juce::BigInteger midiNotes;         // Range of MIDI notes the sound can be played by
+    int length = 0;                     // Number of samples of actual data (not including the padding)
+    int midiRootNote = 0;               // The MIDI note the data plays at its original pitch
+    std::shared_ptr<const PitchVariantArray> pitchVariants;  // Pre-rendered octaves of the data, (null if there are none)
+    StreamSource::Ptr streamSource;     // Where the rest of the sample is streamed from, (null if it is all in the data)
+
+    juce::ADSR::Parameters params;      // Envelope applied to each note
+
+    JUCE_LEAK_DETECTOR(CrushedSound)
+};
+
+//==============================================================================
+/**
+    A voice for the sampler which plays a CrushedSound. Adapted from [3].
+*/
+class CrushedVoice : public juce::SynthesiserVoice
+{
+public:
+    CrushedVoice();
+    ~CrushedVoice() override;
+
+    bool canPlaySound(juce::SynthesiserSound*) override;
+
+    void startNote(int midiNoteNumber, float velocity, juce::SynthesiserSound*, int pitchWheel) override;
+    void stopNote(float velocity, bool allowTailOff) override;
+
+    void pitchWheelMoved(int newValue) override;
+    void controllerMoved(int controllerNumber, int newValue) override;
+
+    void renderNextBlock(juce::AudioBuffer<float>&, int startSample, int numSamples) override;
+    using SynthesiserVoice::renderNextBlock;
+
+    // How loud the voice currently is, (its gain times its envelope), used to decide which voice to steal
+    float getCurrentLevel() const noexcept { return currentLevel; }
+
+    // Gives the voice its own read-ahead window for streamed sounds, (a voice without one can't play them)
+    void setStreamRing(StreamRing* ring) noexcept { streamRing = ring; }
+
+    // Whether the voice is playing a Direct Sound sample, in which case the synthesiser's mixer renders it rather than renderNextBlock()
+    bool isMixedByDirectSound() const noexcept { return playingDirect != nullptr && getCurrentlyPlayingSound() != nullptr; }
+
+    // Adds numTicks ticks of the Direct Sound sample, times the voice's 8 bit volume, to the mixer's accumulator
+    void renderDirectSound(int* accumulator, int numTicks, double mixRate) noexcept;
+
+private:
+    static constexpr int renderChunkSize = 256; // Number of samples rendered into the voice's own buffers before being mixed into the output
+
+    void finishNote();                  // Ends the note straight away, releasing any streaming request
+
+    // Renders up to chunkSize samples of wave RAM frames into the left chunk, returning how many were rendered
+    int renderWaveChunk(int chunkSize, float& envelopeValue, bool& noteFinished) noexcept;
+
+    const juce::AudioBuffer<float>* playingData = nullptr;  // Data of the sound (or its pitch variant) being played
+    const LevelCodes* playingCodes = nullptr;                // Or the level codes of the sound being played
+    const WaveRAMFrames* playingWave = nullptr;              // Or the wave RAM frames of the sound being played
+    const DirectSoundSample* playingDirect = nullptr;        // Or the Direct Sound sample of the sound being played
+    juce::int64 playingLength = 0;      // Number of samples of actual data being played, (including any streamed part)
+
+    StreamRing* streamRing = nullptr;   // This voice's read-ahead window for streamed sounds
+    bool streaming = false;             // Whether the current note is streamed
+    juce::uint32 streamRequest = 0;     // Number of the streaming request made for the current note
+    int headLength = 0;                 // Number of samples at the start of a streamed sound that are held in its data
+
+    double pitchRatio = 0;              // Number of source samples to step through per output sample
+    double sourceSamplePosition = 0;    // Current (fractional) playback position in the source data
+    juce::uint64 wavePhase = 0;         // Playback position in the wave RAM frames, in 32.32 fixed point
+    juce::uint64 wavePhaseStep = 0;     // Frame samples stepped through per output sample, in 32.32 fixed point
+    float waveLevels[16] = {};          // Output level of each nibble value of the frames being played
+    double directNoteRate = 0;          // Direct Sound samples stepped through per second for the note
+    double directMixRate = 0;           // Mixing rate the step below was worked out for
+    juce::uint64 directPhase = 0;       // Playback position in the Direct Sound sample, in 32.32 fixed point
+    juce::uint64 directPhaseStep = 0;   // Direct Sound samples stepped through per tick of the mixer, in 32.32 fixed point
+    float lgain = 0, rgain = 0;         // Left and right gain from the note velocity
+    float currentLevel = 0;             // Gain times envelope at the end of the last rendered chunk
+
+    float chunkL[renderChunkSize];      // Left (or only) channel of the chunk being rendered
+    float chunkR[renderChunkSize];      // Right channel of the chunk being rendered
+
+    juce::ADSR adsr;                    // Envelope of the current note
+
+    JUCE_LEAK_DETECTOR(CrushedVoice)
+};
+
+//==============================================================================
+/**
+    The sampler itself, which holds a single sound that can be swapped for a new
+    one from the audio thread without allocating or freeing any memory.
+*/
+class CrushedSynthesiser : public juce::Synthesiser
+{
+public:
+    CrushedSynthesiser();
+
+    // Which voice is cut off when a new note needs a voice and they are all in use
+    enum class StealingPolicy
+    {
+        oldestNote,     // The voice whose note started first, (preferring voices whose key has already been released)
+        quietestVoice   // The voice which is currently quietest
+    };
+
+    // Sets how many of the voices may be used at once, (voices above the limit finish their current note)
+    void setVoiceLimit(int newVoiceLimit) noexcept;
+    int getVoiceLimit() const noexcept { return voiceLimit.load(); }
+
+    void setStealingPolicy(StealingPolicy newPolicy) noexcept { stealingPolicy.store(newPolicy); }
+
+    // Replaces the current sound with the given one. The caller must make sure the old sound is still referenced
+    // elsewhere, so it isn't deleted on the audio thread (any voices still playing it carry on until their note ends)
+    void swapSound(juce::SynthesiserSound* newSound);
+
+    // Sets the rate the Direct Sound mixer runs at (called from the audio thread)
+    void setDirectSoundMixRate(double mixRate) noexcept { directSoundMixer.setMixRate(mixRate); }
+
+    void setCurrentPlaybackSampleRate(double sampleRate) override;
+
+protected:
+    juce::SynthesiserVoice* findFreeVoice(juce::SynthesiserSound* soundToPlay, int midiChannel, int midiNoteNumber, bool stealIfNoneAvailable) const override;
+    juce::SynthesiserVoice* findVoiceToSteal(juce::SynthesiserSound* soundToPlay, int midiChannel, int midiNoteNumber) const override;
+
+    // Renders the voices as juce::Synthesiser does, apart from those playing Direct Sound samples, which are mixed together
+    // at the mixing rate and added to the output once
+    void renderVoices(juce::AudioBuffer<float>& outputAudio, int startSample, int numSamples) override;
+    using Synthesiser::renderVoices;
+
+private:
+    DirectSoundMixer directSoundMixer;                                      // Mixes the voices playing Direct Sound samples
+
+    std::atomic<int> voiceLimit{ 1 };                                       // Number of voices that may be used at once
+    std::atomic<StealingPolicy> stealingPolicy{ StealingPolicy::oldestNote };  // How a voice is chosen to be stolen
+
+    JUCE_LEAK_DETECTOR(CrushedSynthesiser)
+};
@@ -0,0 +1,110 @@
+/*
+  ==================================================================================
+
+    Implementation file for the GBA Direct Sound emulation of a JUCE VST video game
+    sample emulation plugin. The GBA plays samples by having the CPU mix every
+    voice in software into 8 bit signed PCM, which a timer feeds from a FIFO to the
+    DAC at the mixing rate, so the voices are summed in integer arithmetic at that
+    low rate and only the mixed result is brought up to the host's rate
+
+  ==================================================================================
+*/
+
+#include "DirectSoundMixer.h"
+
+//==============================================================================
+DirectSoundSample::DirectSoundSample(const float* data, int numSamples)
+    : samples((size_t)juce::jmax(0, numSamples))
+{
+    // Full scale is 128, with the top value clipped to 127 as 8 bit signed PCM has one fewer level above 0 than below
+    for (int i = 0; i < numSamples; i++)
+    {
+        samples[(size_t)i] = (juce::int8)juce::jlimit(-128, 127, juce::roundToInt(data[i] * 128.0f));
+    }
+}
+
+void DirectSoundSample::expand(juce::AudioSampleBuffer& destination) const
+{
+    const int numSamples = getNumSamples();
+
+    destination.setSize(1, numSamples + 4, false, false, true);
+    destination.clear();
+
+    float* channelData = destination.getWritePointer(0);
+    for (int i = 0; i < numSamples; i++)
+    {
+        channelData[i] = samples[(size_t)i] / 128.0f;
+    }
+}
+
+//==============================================================================
+void DirectSoundMixer::prepare(double hostSampleRate) noexcept
+{
+    hostRate = hostSampleRate;
+
+    // Work the step out again against the new host rate
+    const double rate = mixRate;
+    mixRate = 0;
+    setMixRate(rate);
+    reset();
+}
+
+void DirectSoundMixer::setMixRate(double newMixRate) noexcept
+{
+    if (newMixRate == mixRate || newMixRate <= 0 || hostRate <= 0)
+    {
+        return;
+    }
+
+    mixRate = newMixRate;
+    holdPhaseStep = (juce::uint64)(mixRate / hostRate * 4294967296.0);
+
+    // A chunk of this many host samples can't take in more ticks than the accumulator holds, (one spare for rounding)
+    maxChunkSize = juce::jmax(1, (int)((maxTicksPerChunk - 1) * hostRate / mixRate));
+}
+
+int DirectSoundMixer::beginChunk(int numSamples) noexcept
+{
+    jassert(numSamples <= maxChunkSize);
+
+    const juce::uint64 endPhase = holdPhase + (juce::uint64)numSamples * holdPhaseStep;
+    numChunkTicks = juce::jmin(maxTicksPerChunk, (int)((endPhase >> 32) - (holdPhase >> 32)));
+
+    std::fill(accumulator, accumulator + numChunkTicks, 0);
+    return numChunkTicks;
+}
+
+void DirectSoundMixer::endChunk(juce::AudioBuffer<float>& outputBuffer, int startSample, int numSamples) noexcept
+{
+    // Scale each tick back down from the volume's fixed point and clip it to 8 bits, as the mixer writes it to the FIFO
+    for (int tick = 0; tick < numChunkTicks; tick++)
+    {
+        accumulator[tick] = juce::jlimit(-128, 127, accumulator[tick] >> volumeBits);
+    }
+
+    const int numChannels = outputBuffer.getNumChannels();
+    int tick = 0;
+
+    for (int i = 0; i < numSamples; i++)
+    {
+        // Move on to the latest tick the timer has reached by this host sample, if it has reached any
+        const auto previousTick = holdPhase >> 32;
+        holdPhase += holdPhaseStep;
+
+        if (const int newTicks = (int)((holdPhase >> 32) - previousTick))
+        {
+            tick += newTicks;
+            heldLevel = accumulator[juce::jmin(tick, numChunkTicks) - 1] / 128.0f;
+        }
+
+        for (int channel = 0; channel < numChannels; channel++)
+        {
+            outputBuffer.getWritePointer(channel)[startSample + i] += heldLevel;
+        }
+    }
+}
+
+void DirectSoundMixer::reset() noexcept
+{
+    heldLevel = 0;
+}
@@ -0,0 +1,104 @@
+/*
+  ==================================================================================
+
+    Header file for the GBA Direct Sound emulation of a JUCE VST video game sample
+    emulation plugin. The GBA plays samples by having the CPU mix every voice in
+    software into 8 bit signed PCM, which a timer feeds from a FIFO to the DAC at
+    the mixing rate, so the voices are summed in integer arithmetic at that low
+    rate and only the mixed result is brought up to the host's rate
+
+  ==================================================================================
+*/
+
+#pragma once
+
+#include <JuceHeader.h>
+
+//==============================================================================
+/**
+    A processed sample as 8 bit signed PCM, one value per sample at the rate it was
+    converted to, as Direct Sound samples are stored in the cartridge. Mono, as the
+    mixer plays each voice to both Direct Sound channels. The data never changes
+    once encoded, so it can be shared between sounds and read by any number of voices.
+*/
+class DirectSoundSample
+{
+public:
+    // Encodes numSamples samples (normalised to -1 to 1) to 8 bit signed PCM
+    DirectSoundSample(const float* data, int numSamples);
+
+    int getNumSamples() const noexcept                  { return (int)samples.size(); }
+    const juce::int8* getData() const noexcept          { return samples.data(); }
+
+    // The output level of a sample, (silence past the end)
+    float getSample(juce::int64 index) const noexcept
+    {
+        return index < (juce::int64)samples.size() ? samples[(size_t)index] / 128.0f : 0.0f;
+    }
+
+    // Expands the data into one float per sample, followed by 4 samples of silence as the voice expects of sample data
+    void expand(juce::AudioSampleBuffer& destination) const;
+
+    // Memory used by the data
+    size_t getNumBytes() const noexcept                 { return samples.size(); }
+
+private:
+    std::vector<juce::int8> samples;    // The 8 bit signed PCM data
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(DirectSoundSample)
+};
+
+//==============================================================================
+/**
+    The software mixer that feeds the Direct Sound FIFO. The output is worked out a
+    chunk at a time: the voices add their samples times their 8 bit volume into the
+    chunk's accumulator, one value per tick of the mixing rate, then each tick is
+    scaled back down and clipped to 8 bits as the mixer writes it to the FIFO. Each
+    mixed value is held until the next tick, as the DAC holds it until the timer
+    takes the next one from the FIFO, which is the one upsample to the host's rate.
+
+    Only used from the audio thread, apart from prepare() which is called before
+    playback starts.
+*/
+class DirectSoundMixer
+{
+public:
+    static constexpr int maxTicksPerChunk{ 512 };   // Most ticks mixed in one go, (sets the size of the accumulator)
+    static constexpr int volumeBits{ 8 };           // The voices' volumes are 8 bit fixed point, (256 being full volume)
+
+    // Sets the host's sample rate the mixed output is held to
+    void prepare(double hostSampleRate) noexcept;
+
+    // Sets the mixing rate, (keeping the tick that is being held)
+    void setMixRate(double newMixRate) noexcept;
+    double getMixRate() const noexcept          { return mixRate; }
+
+    // Most host samples that can be rendered in one chunk, so their ticks fit in the accumulator
+    int getMaxChunkSize() const noexcept        { return maxChunkSize; }
+
+    // Starts a chunk of numSamples host samples, (at most the maximum chunk size), clearing the accumulator for its ticks
+    // and returning how many there are
+    int beginChunk(int numSamples) noexcept;
+
+    // Where the voices add each tick of their sample times their volume
+    int* getAccumulator() noexcept              { return accumulator; }
+
+    // Clips the chunk's ticks to 8 bits and adds them, held over the host samples, to every channel of the output
+    void endChunk(juce::AudioBuffer<float>& outputBuffer, int startSample, int numSamples) noexcept;
+
+    // Goes back to silence, (when no voice is being mixed)
+    void reset() noexcept;
+
+private:
+    double hostRate = 44100;            // Host's sample rate
+    double mixRate = 0;                 // Rate the mixer runs at
+    juce::uint64 holdPhase = 0;         // Ticks passed, in 32.32 fixed point, (the integer part wraps, only its changes are used)
+    juce::uint64 holdPhaseStep = 0;     // Ticks per host sample, in 32.32 fixed point
+    int maxChunkSize = 1;               // Most host samples in one chunk
+    int numChunkTicks = 0;              // Ticks in the chunk being mixed
+    float heldLevel = 0;                // Output level of the tick being held
+
+    int accumulator[maxTicksPerChunk] = {};     // Sum of every voice for each tick of the chunk
+
+    JUCE_LEAK_DETECTOR(DirectSoundMixer)
+};
@@ -0,0 +1,78 @@
+/*
+  ==================================================================================
+
+    Implementation file for the block-wise sample rate conversion of a JUCE VST
+    video game sample emulation plugin. The original sample is read a block at a
+    time, normalised, and reduced to the value each section of the sample rate
+    conversion is held at, so it is never copied in full
+
+  ==================================================================================
+*/
+
+#include "HoldValueReader.h"
+
+//==============================================================================
+HoldValueReader::HoldValueReader(int channels, int samples, const CrushKernels::HoldSections& holdSections, float dataGain, ReadFunction readFunction)
+    : numChannels(channels),
+      numSamples(samples),
+      sections(holdSections),
+      gain(dataGain),
+      read(std::move(readFunction)),
+      block(channels, juce::jmin(blockSize, samples) + 1),
+      values(channels, (int)std::ceil((double)(juce::jmin(blockSize, samples) + 1) * holdSections.sectionsPerSample) + 1)
+{
+}
+
+int HoldValueReader::readNextBlock()
+{
+    if (isFinished() || numChannels == 0)
+    {
+        return 0;
+    }
+
+    const int numBlockSamples = juce::jmin(blockSize, numSamples - nextSample);
+    const bool isLastBlock = nextSample + numBlockSamples >= numSamples;
+    const int numToRead = numBlockSamples + (isLastBlock ? 0 : 1);
+
+    read(block, nextSample, numToRead);
+
+    // Normalised before the values are worked out, as the whole of the data would be
+    if (gain > 0)
+    {
+        block.applyGain(0, numToRead, gain);
+    }
+
+    // Every channel steps through the same sections, so each starts from the same position
+    auto blockPosition = position;
+    int numValues = 0;
+
+    for (int channel = 0; channel < numChannels; channel++)
+    {
+        blockPosition = position;
+        numValues = CrushKernels::getBlockHoldValues(block.getReadPointer(channel), nextSample, numBlockSamples, isLastBlock,
+                                                     sections, blockPosition, values.getWritePointer(channel));
+    }
+
+    position = blockPosition;
+    nextSample += numBlockSamples;
+
+    return numValues;
+}
+
+void HoldValueReader::readAll(juce::AudioSampleBuffer& destination)
+{
+    destination.setSize(numChannels, getNumSections(), false, false, true);
+    int numWritten = 0;
+
+    while (!isFinished())
+    {
+        const int numValues = juce::jmin(readNextBlock(), destination.getNumSamples() - numWritten);
+
+        for (int channel = 0; channel < numChannels; channel++)
+        {
+            destination.copyFrom(channel, numWritten, values, channel, 0, numValues);
+        }
+
+        numWritten += numValues;
+    }
+}
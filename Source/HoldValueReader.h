@@ -0,0 +1,69 @@
+/*
+  ==================================================================================
+
+    Header file for the block-wise sample rate conversion of a JUCE VST video
+    game sample emulation plugin. The original sample is read a block at a time,
+    normalised, and reduced to the value each section of the sample rate
+    conversion is held at, so it is never copied in full
+
+  ==================================================================================
+*/
+
+#pragma once
+
+#include <JuceHeader.h>
+#include "CrushKernels.h"
+
+//==============================================================================
+/**
+    Works out the hold values of a sample, (one per emulated sample for every
+    channel, as CrushKernels::getHoldValues does), from data read a block at a
+    time. Only a block of the data and the values of the sections starting in it
+    are held at once, so a memory mapped or streamed sample can be converted
+    without its whole length ever being decoded into memory.
+
+    Each block is read with the first sample of the next block on the end, so
+    the section straddling the two can be worked out, and is scaled by the gain
+    before its values are worked out, so they match those of normalised data.
+*/
+class HoldValueReader
+{
+public:
+    // Reads numSamples samples of every channel, starting at startSample, into the start of the block
+    using ReadFunction = std::function<void(juce::AudioSampleBuffer& block, int startSample, int numSamples)>;
+
+    // Reads numSamples samples of data with numChannels channels through read, scaled by gain, (0 leaves it as it is)
+    HoldValueReader(int numChannels, int numSamples, const CrushKernels::HoldSections& sections, float gain, ReadFunction read);
+
+    // Reads the next block and works out the values of the sections starting in it, returning how many there are for each
+    // channel, (0 once every block has been read)
+    int readNextBlock();
+
+    // The values worked out from the last block read
+    const float* getValues(int channel) const noexcept  { return values.getReadPointer(channel); }
+
+    // Whether every block has been read
+    bool isFinished() const noexcept                    { return nextSample >= numSamples; }
+
+    // Number of values for each channel across the whole of the data
+    int getNumSections() const noexcept                 { return sections.getNumSections(numSamples); }
+
+    // Reads every block, writing the values of every section to the destination, (resized to hold them)
+    void readAll(juce::AudioSampleBuffer& destination);
+
+    static constexpr int blockSize{ 65536 };    // Samples read in one go
+
+private:
+    const int numChannels;                          // Number of channels in the data
+    const int numSamples;                           // Number of samples in the data
+    const CrushKernels::HoldSections sections;      // The sections each value is held over
+    const float gain;                               // Scale applied to the data as it is read
+    ReadFunction read;                              // Reads a block of the data
+
+    juce::AudioSampleBuffer block;                  // The block being worked on, with room for the next block's first sample
+    juce::AudioSampleBuffer values;                 // Values of the sections starting in the block
+    CrushKernels::HoldSections::Position position;  // Start of the next section to be worked out
+    int nextSample = 0;                             // First sample of the next block
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(HoldValueReader)
+};
@@ -0,0 +1,60 @@
+/*
+  ==================================================================================
+
+    Implementation file for the compact storage of processed samples of a JUCE
+    VST video game sample emulation plugin. The bit crushed sample is kept as the
+    level index of each emulated sample at the emulated sample rate, rather than
+    as a float for every sample at the source rate, and is expanded as it is played
+
+  ==================================================================================
+*/
+
+#include "LevelCodes.h"
+
+//==============================================================================
+LevelCodes::LevelCodes(int channels, int codesPerChannel, int codeBitDepth, const CrushKernels::HoldSections& codeSections, int samplesStoodFor)
+    : numChannels(channels),
+      numCodes(codesPerChannel),
+      bitDepth(codeBitDepth),
+      sections(codeSections),
+      numSamples(samplesStoodFor),
+      levels(codeBitDepth)
+{
+    const size_t totalCodes = (size_t)numChannels * (size_t)numCodes;
+
+    if (hasEightBitCodes())
+    {
+        eightBitCodes.resize(totalCodes);
+    }
+    else
+    {
+        sixteenBitCodes.resize(totalCodes);
+    }
+}
+
+void LevelCodes::expand(juce::AudioSampleBuffer& destination) const
+{
+    destination.setSize(numChannels, numSamples + 4, false, false, true);
+
+    for (int channel = 0; channel < numChannels; channel++)
+    {
+        expand(channel, 0, numSamples + 4, destination.getWritePointer(channel));
+    }
+}
+
+void LevelCodes::expand(int channel, int startSample, int numSamplesToExpand, float* destination) const noexcept
+{
+    // Each code's level is held over the same section getSample() reads it back from
+    const size_t channelStart = (size_t)channel * (size_t)numCodes;
+
+    CrushKernels::expandSections(sections, numCodes, numSamples, startSample, numSamplesToExpand, destination, [&](int section)
+    {
+        auto code = hasEightBitCodes() ? (int)eightBitCodes[channelStart + (size_t)section] : (int)sixteenBitCodes[channelStart + (size_t)section];
+        return levels.getLevel(code);
+    });
+}
+
+size_t LevelCodes::getNumBytes() const noexcept
+{
+    return eightBitCodes.size() * sizeof(juce::uint8) + sixteenBitCodes.size() * sizeof(juce::uint16);
+}
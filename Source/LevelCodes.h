@@ -0,0 +1,82 @@
+/*
+  ==================================================================================
+
+    Header file for the compact storage of processed samples of a JUCE VST video
+    game sample emulation plugin. The bit crushed sample is kept as the level
+    index of each emulated sample at the emulated sample rate, rather than as a
+    float for every sample at the source rate, and is expanded as it is played
+
+  ==================================================================================
+*/
+
+#pragma once
+
+#include <JuceHeader.h>
+#include "CrushKernels.h"
+
+//==============================================================================
+/**
+    A bit crushed sample stored as level codes. Each code is the index of an
+    emulated sample's level in the PCM level grid for the bit depth, and covers
+    one section of the data it stands for, (the same sections the sample rate
+    conversion holds each value over). Codes are 8 bit for bit depths up to
+    8 and 16 bit above that, so a 7 bit NES sample at 4177.4 Hz takes around 40
+    times less memory than the equivalent float data at 44.1 kHz.
+
+    The codes never change once they have been calculated, so they can be shared
+    between sounds and read by any number of voices.
+*/
+class LevelCodes
+{
+public:
+    // Room for numCodes codes per channel, standing for numSamples samples of data with one code per section
+    LevelCodes(int channels, int codesPerChannel, int codeBitDepth, const CrushKernels::HoldSections& codeSections, int samplesStoodFor);
+
+    int getNumChannels() const noexcept     { return numChannels; }
+    int getNumCodes() const noexcept        { return numCodes; }
+    int getNumSamples() const noexcept      { return numSamples; }
+    int getBitDepth() const noexcept        { return bitDepth; }
+    double getIncrement() const noexcept    { return sections.getIncrement(); }
+
+    // Whether the codes are stored in 8 bits, otherwise they are stored in 16
+    bool hasEightBitCodes() const noexcept  { return bitDepth <= 8; }
+
+    // Where a channel's codes are written when they are calculated
+    juce::uint8* getEightBitCodes(int channel) noexcept     { return eightBitCodes.data() + (size_t)channel * (size_t)numCodes; }
+    juce::uint16* getSixteenBitCodes(int channel) noexcept  { return sixteenBitCodes.data() + (size_t)channel * (size_t)numCodes; }
+
+    // The value of the data at a sample index, (silence past the end, so the voice can interpolate into it)
+    float getSample(int channel, juce::int64 index) const noexcept
+    {
+        if (index >= numSamples)
+        {
+            return 0.0f;
+        }
+
+        // Each code holds its level over the same section as in the sample rate conversion
+        auto code = (size_t)channel * (size_t)numCodes + (size_t)juce::jmin(sections.getSection(index), numCodes - 1);
+        return levels.getLevel(hasEightBitCodes() ? (int)eightBitCodes[code] : (int)sixteenBitCodes[code]);
+    }
+
+    // Expands the codes into one float per sample, followed by 4 samples of silence as the voice expects of sample data
+    void expand(juce::AudioSampleBuffer& destination) const;
+
+    // Expands a range of one channel's samples into floats, (silence for any part of the range outside the data)
+    void expand(int channel, int startSample, int numSamplesToExpand, float* destination) const noexcept;
+
+    // Memory used by the codes
+    size_t getNumBytes() const noexcept;
+
+private:
+    const int numChannels;                      // Number of channels
+    const int numCodes;                         // Number of codes per channel
+    const int bitDepth;                         // Bit depth of the level grid the codes index
+    const CrushKernels::HoldSections sections;  // The sections of the data each code stands for
+    const int numSamples;                       // Number of samples of data the codes stand for
+    const CrushKernels::PCMLevels levels;       // The level grid the codes index
+
+    std::vector<juce::uint8> eightBitCodes;     // Each channel's codes one after the other, (empty if they need 16 bits)
+    std::vector<juce::uint16> sixteenBitCodes;  // Each channel's codes one after the other, (empty if they fit in 8 bits)
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(LevelCodes)
+};
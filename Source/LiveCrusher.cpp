@@ -0,0 +1,97 @@
+/*
+  ==================================================================================
+
+    Implementation file for the real time bit crusher of a JUCE VST video game
+    sample emulation plugin, which applies the selected console's emulation to
+    the incoming audio block by block when the plugin is used as an effect
+
+  ==================================================================================
+*/
+
+#include "LiveCrusher.h"
+#include "CrushKernels.h"
+
+//==============================================================================
+LiveCrusher::LiveCrusher() {}
+
+void LiveCrusher::prepare(double sampleRate, int numChannels)
+{
+    hostSampleRate = sampleRate;
+    channels.resize(numChannels);
+    reset();
+}
+
+void LiveCrusher::reset()
+{
+    for (auto& state : channels)
+    {
+        state = ChannelState();
+    }
+}
+
+void LiveCrusher::process(juce::AudioBuffer<float>& buffer, int numChannels, const Parameters& crushParams)
+{
+    // Every console is crushed sample by sample as PCM or DPCM at its rate and bit depth. Encodings which can't be done a
+    // sample at a time are approximated: SNES BRR as DPCM with its slope, GameBoy wave RAM as 4 bit PCM at the wave channel's
+    // rate, (without the volume shift or the repeating 32 sample frames), and GBA Direct Sound as 8 bit PCM at the mixing
+    // rate, (crushed on its own rather than mixed with the voices in integer arithmetic). Only a console without a profile
+    // is left untouched
+    if (!ConsoleProfiles::isEmulated(crushParams.console))
+    {
+        return;
+    }
+
+    const CrushKernels::PCMLevels levels(crushParams.bitDepth);
+    const CrushKernels::DPCMSteps steps(crushParams.DPCMBit);
+    const int lastIndex = (int)levels.lastLevel;
+
+    const double increment = hostSampleRate / crushParams.sampleRate;  // Number of host samples per emulated sample
+    const int numSamples = buffer.getNumSamples();
+
+    numChannels = juce::jmin(numChannels, buffer.getNumChannels(), channels.size());
+
+    for (int channel = 0; channel < numChannels; ++channel)
+    {
+        auto& state = channels.getReference(channel);
+        auto* channelData = buffer.getWritePointer(channel);
+
+        int i = 0;
+        while (i < numSamples)
+        {
+            // Take a new emulated sample from the input when the current hold has finished
+            if (state.samplesUntilNextHold <= 0)
+            {
+                float inputSample = channelData[i];
+
+                if (crushParams.DPCM)
+                {
+                    // Step from the previous level towards the input, starting from 0
+                    if (state.DPCMIndex < 0)
+                    {
+                        state.DPCMIndex = levels.getZeroIndex();
+                    }
+                    else
+                    {
+                        bool inputIsAbove = inputSample > levels.getLevel(state.DPCMIndex);
+                        state.DPCMIndex += steps.getChange(state.DPCMIndex, CrushKernels::quantiseIndexPCM(levels, inputSample), inputIsAbove, lastIndex);
+                    }
+
+                    state.heldValue = levels.getLevel(state.DPCMIndex);
+                }
+                else
+                {
+                    state.heldValue = CrushKernels::quantiseSamplePCM(levels, inputSample);
+                }
+
+                state.samplesUntilNextHold += increment;
+            }
+
+            // Hold the value for the rest of the hold, or to the end of the block (carrying on in the next one)
+            int holdLength = juce::jmin(numSamples - i, (int)std::ceil(state.samplesUntilNextHold));
+            juce::FloatVectorOperations::fill(channelData + i, state.heldValue, holdLength);
+
+            i += holdLength;
+            state.samplesUntilNextHold -= holdLength;
+        }
+    }
+}
@@ -0,0 +1,53 @@
+/*
+  ==================================================================================
+
+    Header file for the real time bit crusher of a JUCE VST video game sample
+    emulation plugin, which applies the selected console's emulation to the
+    incoming audio block by block when the plugin is used as an effect
+
+  ==================================================================================
+*/
+
+#pragma once
+
+#include <JuceHeader.h>
+#include "Parameters.h"
+
+//==============================================================================
+/**
+    Streaming version of the sample bit crush. Each channel keeps its own sample
+    and hold phase and DPCM level between blocks, so the output is the same as if
+    the whole input had been processed in one go, with no added latency.
+
+    Unlike the sample path the input isn't normalised first (the whole signal
+    isn't known in advance), so anything outside -1 to 1 is clamped to the
+    highest or lowest level.
+*/
+class LiveCrusher
+{
+public:
+    LiveCrusher();
+
+    // Sets up the per channel state, (call before processing, not on the audio thread)
+    void prepare(double sampleRate, int numChannels);
+
+    // Puts every channel back to the start of a hold at level 0
+    void reset();
+
+    // Bit crushes the first numChannels channels of the buffer in place
+    void process(juce::AudioBuffer<float>& buffer, int numChannels, const Parameters& crushParams);
+
+private:
+    // State carried from one block to the next for a channel
+    struct ChannelState
+    {
+        double samplesUntilNextHold = 0;    // Number of host samples left before the next emulated sample is taken
+        float heldValue = 0;                // Value of the current emulated sample
+        int DPCMIndex = -1;                 // Current DPCM level index, (-1 until the first emulated sample)
+    };
+
+    double hostSampleRate = 44100.0;        // Sample rate of the incoming audio
+    juce::Array<ChannelState> channels;     // State of each channel
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(LiveCrusher)
+};
@@ -0,0 +1,68 @@
+/*
+  ==================================================================================
+
+    Header file for the parameters of a JUCE VST video game sample emulation
+    plugin, which are shared between the processor and the background renderer
+
+  ==================================================================================
+*/
+
+// Parameter control and such adapted from:
+// [1]
+/***********************************************************************************
+* Title: SimpleEQ
+* Author: matkatmusic
+* Date: 16 Apr 2021
+* Code Version: Unknown
+* Availability: https://github.com/matkatmusic/SimpleEQ
+***********************************************************************************/
+
+#pragma once
+
+#include <JuceHeader.h>
+#include "ConsoleProfiles.h"
+
+namespace ConsoleTables
+{
+    // Names of the consoles, indexed by Console
+    constexpr const char* consoleNames[] = { "NES", "SNES", "GameBoy", "GBA" };
+    constexpr int numConsoles = (int)(sizeof(consoleNames) / sizeof(consoleNames[0]));
+
+    constexpr const char* getConsoleName(Console console) noexcept
+    {
+        return consoleNames[(int)console];
+    }
+
+    // The console with the given name, (e.g. from a preset file), or NES if there isn't one
+    inline Console getConsoleFromName(const juce::String& name)
+    {
+        for (int i = 0; i < numConsoles; i++)
+        {
+            if (name.equalsIgnoreCase(consoleNames[i]))
+            {
+                return (Console)i;
+            }
+        }
+
+        return Console::NES;
+    }
+}
+
+// Adapted from [1]. Used to store the current values of the parameters that the user can control
+struct Parameters
+{
+    Console console = Console::NES; // The currently selected console's sampling to be emulated
+    bool DPCM = false;              // Whether DPCM is being used
+    int DPCMBit = 1;                // The bit size of the DPCM
+    bool BRR = false;               // Whether the sample is encoded as SNES BRR blocks, (instead of the bit depth and DPCM parameters)
+    bool waveRAM = false;           // Whether the sample is encoded as GameBoy wave RAM frames, (instead of the bit depth and DPCM parameters)
+    int volumeShift = 0;            // The GameBoy wave channel's volume shift, (0 for 100%, 1 for 50%, 2 for 25%)
+    bool directSound = false;       // Whether the sample is played through the GBA's Direct Sound mixer, (as 8 bit signed PCM at the mixing rate)
+    int sampleMIDINote = 60;        // The MIDI Note the original audio is played at
+    int bitDepth = 16;              // Number of bits that would represent the amplitude to be emulated
+    float sampleRate = 44100;       // Sample rate to be emulated
+    bool effectMode = false;        // Whether the incoming audio is also bit crushed in real time
+    int numVoices = 1;              // Number of notes that can be played at once
+    bool stealQuietest = false;     // Whether the quietest voice is stolen for a new note, (rather than the oldest note)
+    bool pitchVariants = false;     // Whether octaves of the processed sample are pre-rendered for notes far above the root note
+};
@@ -0,0 +1,168 @@
+/*
+  ==================================================================================
+
+    Implementation file for the performance counters of a JUCE VST video game
+    sample emulation plugin, which time each stage of processing the sample and
+    how much of each audio block's time budget the processor uses
+
+  ==================================================================================
+*/
+
+#include "PerformanceCounters.h"
+
+//==============================================================================
+const char* PerformanceCounters::getStageName(Stage stage)
+{
+    switch (stage)
+    {
+        case Stage::readFile:       return "Read file";
+        case Stage::resample:       return "Resample";
+        case Stage::normalise:      return "Normalise";
+        case Stage::quantise:       return "Quantise";
+        case Stage::pitchVariants:  return "Pitch variants";
+        case Stage::buildSound:     return "Build sound";
+        case Stage::exportFile:     return "Export file";
+        case Stage::numStages:      break;
+    }
+
+    return "";
+}
+
+void PerformanceCounters::addStageTime(Stage stage, double seconds) noexcept
+{
+    auto& counters = stages[(size_t)stage];
+    auto ns = (juce::int64)(seconds * 1.0e9);
+
+    counters.count.fetch_add(1, std::memory_order_relaxed);
+    counters.totalNs.fetch_add(ns, std::memory_order_relaxed);
+    counters.lastNs.store(ns, std::memory_order_relaxed);
+
+    // Raise the maximum if this is the longest yet, (retrying if another thread changed it in between)
+    auto currentMax = counters.maxNs.load(std::memory_order_relaxed);
+    while (ns > currentMax && !counters.maxNs.compare_exchange_weak(currentMax, ns, std::memory_order_relaxed))
+    {
+    }
+}
+
+// Called from the audio thread, so only does a few relaxed atomic operations
+void PerformanceCounters::addBlockTime(double seconds, double budgetSeconds) noexcept
+{
+    if (budgetSeconds <= 0)
+    {
+        return;
+    }
+
+    auto percent = (float)(100.0 * seconds / budgetSeconds);
+    auto bucket = juce::jlimit(0, numBlockBuckets - 1, (int)(percent * bucketsPerPercent));
+
+    blockBuckets[bucket].fetch_add(1, std::memory_order_relaxed);
+    lastBlockBudgetUs.store(budgetSeconds * 1.0e6, std::memory_order_relaxed);
+
+    if (percent > 100.0f)
+    {
+        blockOverruns.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    // Only the audio thread writes this, so no compare and swap is needed
+    if (percent > maxBlockPercent.load(std::memory_order_relaxed))
+    {
+        maxBlockPercent.store(percent, std::memory_order_relaxed);
+    }
+}
+
+void PerformanceCounters::reset() noexcept
+{
+    for (auto& counters : stages)
+    {
+        counters.count = 0;
+        counters.totalNs = 0;
+        counters.lastNs = 0;
+        counters.maxNs = 0;
+    }
+
+    for (auto& bucket : blockBuckets)
+    {
+        bucket = 0;
+    }
+
+    blockOverruns = 0;
+    maxBlockPercent = 0;
+}
+
+PerformanceCounters::StageStats PerformanceCounters::getStageStats(Stage stage) const noexcept
+{
+    auto& counters = stages[(size_t)stage];
+
+    StageStats stats;
+    stats.count = counters.count.load();
+    stats.lastMs = counters.lastNs.load() / 1.0e6;
+    stats.averageMs = stats.count > 0 ? counters.totalNs.load() / 1.0e6 / (double)stats.count : 0.0;
+    stats.maxMs = counters.maxNs.load() / 1.0e6;
+    return stats;
+}
+
+PerformanceCounters::BlockStats PerformanceCounters::getBlockStats() const noexcept
+{
+    // Count the buckets rather than using blockCount, as blocks may be added while they are being read
+    juce::int64 totalCount = 0;
+    for (auto& bucket : blockBuckets)
+    {
+        totalCount += bucket.load(std::memory_order_relaxed);
+    }
+
+    BlockStats stats;
+    stats.count = totalCount;
+    stats.p50Percent = getBlockPercentile(0.5, totalCount);
+    stats.p99Percent = getBlockPercentile(0.99, totalCount);
+    stats.maxPercent = maxBlockPercent.load();
+    stats.overruns = blockOverruns.load();
+
+    auto budgetUs = lastBlockBudgetUs.load();
+    stats.p50Us = stats.p50Percent / 100.0 * budgetUs;
+    stats.p99Us = stats.p99Percent / 100.0 * budgetUs;
+    return stats;
+}
+
+double PerformanceCounters::getBlockPercentile(double fraction, juce::int64 totalCount) const noexcept
+{
+    if (totalCount == 0)
+    {
+        return 0.0;
+    }
+
+    auto target = (juce::int64)std::ceil(fraction * (double)totalCount);
+    juce::int64 countSoFar = 0;
+
+    for (int bucket = 0; bucket < numBlockBuckets; bucket++)
+    {
+        countSoFar += blockBuckets[bucket].load(std::memory_order_relaxed);
+
+        // Report the top of the bucket the percentile falls in
+        if (countSoFar >= target)
+        {
+            return (bucket + 1) / (double)bucketsPerPercent;
+        }
+    }
+
+    return numBlockBuckets / (double)bucketsPerPercent;
+}
+
+juce::StringArray PerformanceCounters::getSummary() const
+{
+    juce::StringArray lines;
+
+    auto block = getBlockStats();
+    lines.add("processBlock: " + juce::String(block.count) + " blocks");
+    lines.add("  p50 " + juce::String(block.p50Percent, 1) + "% (" + juce::String(block.p50Us, 0) + " us), p99 "
+              + juce::String(block.p99Percent, 1) + "% (" + juce::String(block.p99Us, 0) + " us)");
+    lines.add("  max " + juce::String(block.maxPercent, 1) + "%, " + juce::String(block.overruns) + " over budget");
+
+    for (int i = 0; i < (int)Stage::numStages; i++)
+    {
+        auto stats = getStageStats((Stage)i);
+        lines.add(juce::String(getStageName((Stage)i)) + ": " + juce::String(stats.lastMs, 2) + " ms (avg "
+                  + juce::String(stats.averageMs, 2) + ", max " + juce::String(stats.maxMs, 2) + ", x" + juce::String(stats.count) + ")");
+    }
+
+    return lines;
+}
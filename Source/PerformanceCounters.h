@@ -0,0 +1,116 @@
+/*
+  ==================================================================================
+
+    Header file for the performance counters of a JUCE VST video game sample
+    emulation plugin, which time each stage of processing the sample and how much
+    of each audio block's time budget the processor uses
+
+  ==================================================================================
+*/
+
+#pragma once
+
+#include <JuceHeader.h>
+
+//==============================================================================
+/**
+    Timing counters for the plugin. Every counter is an atomic, so they can be
+    updated from the audio thread without locking, and read from anywhere (e.g.
+    the editor's overlay or an automated check).
+*/
+class PerformanceCounters
+{
+public:
+    // The timed stages of loading, processing and exporting the sample
+    enum class Stage
+    {
+        readFile,       // Reading the original sample from its file
+        resample,       // Converting to the emulated sample rate
+        normalise,      // Scaling so the maximum value is 1
+        quantise,       // Converting to the emulated bit depth, (PCM or DPCM)
+        pitchVariants,  // Pre-rendering the octaves of the processed sample
+        buildSound,     // Building the sampler sound around the processed data
+        exportFile,     // Writing the processed sample to a file
+        numStages
+    };
+
+    static const char* getStageName(Stage stage);
+
+    // Times a stage from construction until it goes out of scope
+    class ScopedStageTimer
+    {
+    public:
+        ScopedStageTimer(PerformanceCounters& countersToUse, Stage stageToTime)
+            : counters(countersToUse), stage(stageToTime), startTicks(juce::Time::getHighResolutionTicks())
+        {
+        }
+
+        ~ScopedStageTimer()
+        {
+            counters.addStageTime(stage, juce::Time::highResolutionTicksToSeconds(juce::Time::getHighResolutionTicks() - startTicks));
+        }
+
+    private:
+        PerformanceCounters& counters;  // Where the time is added
+        const Stage stage;              // Which stage is being timed
+        const juce::int64 startTicks;   // When the stage started
+
+        JUCE_DECLARE_NON_COPYABLE(ScopedStageTimer)
+    };
+
+    void addStageTime(Stage stage, double seconds) noexcept;
+
+    // Adds a processBlock duration to the histogram, (budgetSeconds is the length of the block in real time)
+    void addBlockTime(double seconds, double budgetSeconds) noexcept;
+
+    // Clears every counter
+    void reset() noexcept;
+
+    // Totals for one stage
+    struct StageStats
+    {
+        juce::int64 count = 0;      // Number of times the stage has run
+        double lastMs = 0;          // How long it took the last time
+        double averageMs = 0;       // How long it takes on average
+        double maxMs = 0;           // The longest it has taken
+    };
+
+    // processBlock timings, as a percentage of the block's time budget and in microseconds
+    struct BlockStats
+    {
+        juce::int64 count = 0;      // Number of blocks timed
+        double p50Percent = 0;      // Median percentage of the budget used
+        double p99Percent = 0;      // 99th percentile percentage of the budget used
+        double maxPercent = 0;      // Highest percentage of the budget used
+        double p50Us = 0;           // Median block time
+        double p99Us = 0;           // 99th percentile block time
+        juce::int64 overruns = 0;   // Number of blocks that took longer than their budget
+    };
+
+    StageStats getStageStats(Stage stage) const noexcept;
+    BlockStats getBlockStats() const noexcept;
+
+    // Every counter as lines of text, for the editor's overlay
+    juce::StringArray getSummary() const;
+
+private:
+    struct StageCounters
+    {
+        std::atomic<juce::int64> count{ 0 };        // Number of times the stage has run
+        std::atomic<juce::int64> totalNs{ 0 };      // Total time spent in the stage
+        std::atomic<juce::int64> lastNs{ 0 };       // Time spent the last time it ran
+        std::atomic<juce::int64> maxNs{ 0 };        // Longest time it has taken
+    };
+
+    // Value at the given fraction of the way through the block histogram, as a percentage of the budget
+    double getBlockPercentile(double fraction, juce::int64 totalCount) const noexcept;
+
+    static constexpr int bucketsPerPercent{ 2 };                            // Histogram resolution, (half a percent of the budget per bucket)
+    static constexpr int numBlockBuckets{ 200 * bucketsPerPercent + 1 };    // Up to 200% of the budget, with the last bucket for anything over
+
+    StageCounters stages[(size_t)Stage::numStages];                         // Counters for each stage
+    std::atomic<juce::uint32> blockBuckets[numBlockBuckets] = {};           // Number of blocks that used each range of the budget
+    std::atomic<juce::int64> blockOverruns{ 0 };                            // Number of blocks over budget
+    std::atomic<float> maxBlockPercent{ 0 };                                // Highest percentage of the budget used
+    std::atomic<double> lastBlockBudgetUs{ 0 };                             // Budget of the last block, to turn percentages back into times
+};
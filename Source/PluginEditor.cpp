@@ -40,19 +40,36 @@
 ProjectCodeAudioProcessorEditor::ProjectCodeAudioProcessorEditor (ProjectCodeAudioProcessor& p)
     : AudioProcessorEditor (&p), audioProcessor (p),
     // Attach each parameter to the respective user control
-    consoleSelectorAttachment(audioProcessor.apvts, "Console", consoleSelector),                        
-    sampleMIDINoteSelectorAttachment(audioProcessor.apvts, "SampleMidiNote", sampleMIDINoteSelector),   
-    NESBitDepthSliderAttachment(audioProcessor.apvts, "NESBitDepth", NESBitDepthSlider),                
-    NESSampleRateSliderAttachment(audioProcessor.apvts, "NESSampleRate", NESSampleRateSlider), 
+    consoleSelectorAttachment(audioProcessor.apvts, "Console", consoleSelector),
+    sampleMIDINoteSelectorAttachment(audioProcessor.apvts, "SampleMidiNote", sampleMIDINoteSelector),
     PCMorDPCMSelectorAttachment(audioProcessor.apvts, "PCMorDPCM", PCMorDPCMSelector),
+    NESBitDepthSliderAttachment(audioProcessor.apvts, "NESBitDepth", NESBitDepthSlider),
+    NESSampleRateSliderAttachment(audioProcessor.apvts, "NESSampleRate", NESSampleRateSlider),
     SNESBitDepthSliderAttachment(audioProcessor.apvts, "SNESBitDepth", SNESBitDepthSlider),
     SNESSampleRateSliderAttachment(audioProcessor.apvts, "SNESSampleRate", SNESSampleRateSlider),
-    SNESDPCMSliderAttachment(audioProcessor.apvts, "SNESDPCMBit", SNESDPCMSlider)
+    SNESDPCMSliderAttachment(audioProcessor.apvts, "SNESDPCMBit", SNESDPCMSlider),
+    GBSampleRateSliderAttachment(audioProcessor.apvts, "GBSampleRate", GBSampleRateSlider),
+    GBASampleRateSliderAttachment(audioProcessor.apvts, "GBASampleRate", GBASampleRateSlider),
+    numVoicesSliderAttachment(audioProcessor.apvts, "Voices", numVoicesSlider)
 {
     // From [2]
     loadButton.onClick = [&]() { audioProcessor.loadSample(); };    // Run the loadSample() function from audioProcessor when clicked
     addAndMakeVisible(loadButton);                                  // Add the file load button to the GUI
 
+    exportButton.onClick = [&]() { audioProcessor.exportSample(); };    // Run the exportSample() function from audioProcessor when clicked
+    addAndMakeVisible(exportButton);                                    // Add the file export button to the GUI
+
+    exportDMCButton.onClick = [&]() { audioProcessor.exportDMC(); };    // Run the exportDMC() function from audioProcessor when clicked
+    addAndMakeVisible(exportDMCButton);                                 // Add the DMC export button to the GUI
+
+    performanceToggle.onClick = [&]() { repaint(performanceArea); };    // Show or hide the performance counters straight away
+    addAndMakeVisible(performanceToggle);                               // Add the performance overlay toggle to the GUI
+
+    streamedNoteLabel.setFont(juce::Font(13.0f));                       // Small, as it is only a note
+    streamedNoteLabel.setJustificationType(juce::Justification::centred);
+    streamedNoteLabel.setColour(juce::Label::textColourId, juce::Colours::orange);
+    addChildComponent(streamedNoteLabel);                               // Added but only shown for a streamed sample on the GameBoy or GBA
+
     // Control adding adapted from [1]
     addAndMakeVisible(consoleSelector);                                                     // Add the console selector to the GUI
     consoleSelector.addItemList(juce::StringArray("NES", "SNES", "GameBoy", "GBA"), 1);     // Fill the GUI component with the console options
@@ -68,6 +85,19 @@ ProjectCodeAudioProcessorEditor::ProjectCodeAudioProcessorEditor (ProjectCodeAud
     sampleMIDINoteSelector.addItemList(midiNotesStringArray, 1);    // Add the new string array to the GUI component, (options of MIDI notes 12 to 128)
     sampleMIDINoteSelector.setSelectedId(49);                       // Set initial selection to 49th option (MIDI note 60)
 
+    addAndMakeVisible(modeSelector);                                        // Add the sampler/effect mode selector to the GUI
+    modeSelector.addItemList(juce::StringArray("Sampler", "Effect"), 1);   // Fill the GUI component with the mode options
+    modeSelectorAttachment = std::make_unique<APVTS::ComboBoxAttachment>(audioProcessor.apvts, "Mode", modeSelector);  // Then select the saved mode
+
+    addAndMakeVisible(numVoicesSlider);                                                     // Add the polyphony slider to the GUI
+    addAndMakeVisible(voiceStealingSelector);                                               // Add the voice stealing selector to the GUI
+    voiceStealingSelector.addItemList(juce::StringArray("Oldest", "Quietest"), 1);          // Fill the GUI component with the voice stealing options
+    voiceStealingSelectorAttachment = std::make_unique<APVTS::ComboBoxAttachment>(audioProcessor.apvts, "VoiceStealing", voiceStealingSelector);
+
+    addAndMakeVisible(pitchVariantsSelector);                                   // Add the pitch variants selector to the GUI
+    pitchVariantsSelector.addItemList(juce::StringArray("Off", "Octaves"), 1);  // Fill the GUI component with the pitch variant options
+    pitchVariantsSelectorAttachment = std::make_unique<APVTS::ComboBoxAttachment>(audioProcessor.apvts, "PitchVariants", pitchVariantsSelector);
+
     // NES controls made visible first as NES is selected as initial console
     addAndMakeVisible(NESBitDepthSlider);                               // Add NES bit depth slider to the GUI
     addAndMakeVisible(NESSampleRateSlider);                             // Add NES sample rate slider to the GUI
@@ -79,6 +109,18 @@ ProjectCodeAudioProcessorEditor::ProjectCodeAudioProcessorEditor (ProjectCodeAud
     addChildComponent(SNESBitDepthSlider);
     addChildComponent(SNESSampleRateSlider);    
     addChildComponent(SNESDPCMSlider);          
+    addChildComponent(SNESModeSelector);
+    SNESModeSelector.addItemList(juce::StringArray("DPCM", "BRR"), 1);  // Fill DPCM/BRR GUI component with options
+    SNESModeSelectorAttachment = std::make_unique<APVTS::ComboBoxAttachment>(audioProcessor.apvts, "SNESMode", SNESModeSelector);
+
+    // GameBoy controls added but not made visible either
+    addChildComponent(GBSampleRateSlider);
+    addChildComponent(GBVolumeSelector);
+    GBVolumeSelector.addItemList(juce::StringArray("100%", "50%", "25%"), 1); // Fill the wave channel volume GUI component with options
+    GBVolumeSelectorAttachment = std::make_unique<APVTS::ComboBoxAttachment>(audioProcessor.apvts, "GBVolume", GBVolumeSelector);
+
+    // And the GBA's mixing rate, (Direct Sound is always 8 bit, so it has no other controls)
+    addChildComponent(GBASampleRateSlider);
 
     // Listener for each parameter to check when it changes, from from [1]
     const auto& params = audioProcessor.getParameters();
@@ -108,6 +150,28 @@ void ProjectCodeAudioProcessorEditor::paint (juce::Graphics& g)
 {
     // (Our component is opaque, so we must completely fill the background with a solid colour)
     g.fillAll(juce::Colours::black); 
+
+    // Draw the performance counters if the overlay is turned on
+    if (performanceToggle.getToggleState())
+    {
+        g.setColour(juce::Colours::lightgreen);
+        g.setFont(juce::Font(juce::Font::getDefaultMonospacedFontName(), 11.0f, juce::Font::plain));
+
+        auto lines = audioProcessor.getPerformanceCounters().getSummary();
+
+        // Followed by what each part of the plugin is holding in memory, in KB
+        auto memory = audioProcessor.getMemoryUsage();
+        auto toKB = [](size_t bytes) { return juce::String((juce::int64)(bytes / 1024)); };
+        lines.add("Memory (KB): sample " + toKB(memory.originalSample) + ", mapped " + toKB(memory.mappedFile) + ", stages " + toKB(memory.renderStages));
+        lines.add("  cache " + toKB(memory.renderCache) + ", variants " + toKB(memory.pitchVariants) + ", stream "
+                  + toKB(memory.streaming) + ", scratch " + toKB(memory.scratch));
+
+        auto lineArea = performanceArea;
+        for (auto& line : lines)
+        {
+            g.drawText(line, lineArea.removeFromTop(14), juce::Justification::centredLeft, true);
+        }
+    }
 }
 
 void ProjectCodeAudioProcessorEditor::resized()
@@ -119,8 +183,17 @@ void ProjectCodeAudioProcessorEditor::resized()
 
     // Set general controls' positions on GUI
     loadButton.setBounds(0, 0, getWidth() / 4, getHeight() / 4);
+    exportButton.setBounds(0, 3 * getHeight() / 4, getWidth() / 4, getHeight() / 8);
+    exportDMCButton.setBounds(0, 7 * getHeight() / 8, getWidth() / 4, getHeight() / 8);
+    performanceToggle.setBounds(getWidth() - 125, 5 * getHeight() / 6 - 25, 100, 50);
+    performanceArea.setBounds(5, getHeight() / 4 + 5, getWidth() / 4 + 60, getHeight() / 2 - 10);
+    streamedNoteLabel.setBounds(getWidth() / 4 + 10, 5, getWidth() / 2 - 20, 40);
     consoleSelector.setBounds(getWidth() / 2 - 50, getHeight()/6 - 25, 100, 50);
     sampleMIDINoteSelector.setBounds(getWidth() / 2 - 50, 2*getHeight()/6 - 25, 100, 50);
+    modeSelector.setBounds(getWidth() - 125, getHeight() / 6 - 25, 100, 50);
+    numVoicesSlider.setBounds(getWidth() - 225, 2 * getHeight() / 6 - 50, 200, 100);
+    voiceStealingSelector.setBounds(getWidth() - 125, 3 * getHeight() / 6 - 25, 100, 50);
+    pitchVariantsSelector.setBounds(getWidth() - 125, 4 * getHeight() / 6 - 25, 100, 50);
 
     // Set NES controls' positions on GUI
     NESBitDepthSlider.setBounds(getWidth() / 2 - 100, 3 * getHeight() / 6 - 50, 200, 100);
@@ -131,6 +204,14 @@ void ProjectCodeAudioProcessorEditor::resized()
     SNESBitDepthSlider.setBounds(getWidth() / 2 - 100, 3 * getHeight() / 6 - 50, 200, 100);
     SNESSampleRateSlider.setBounds(getWidth() / 2 - 100, 4 * getHeight() / 6 - 50, 200, 100);
     SNESDPCMSlider.setBounds(getWidth() / 2 - 100, 5 * getHeight() / 6 - 50, 200, 100);
+    SNESModeSelector.setBounds(getWidth() / 2 + 110, 5 * getHeight() / 6 - 25, 100, 50);
+
+    // Set GameBoy controls' positions on GUI
+    GBSampleRateSlider.setBounds(getWidth() / 2 - 100, 4 * getHeight() / 6 - 50, 200, 100);
+    GBVolumeSelector.setBounds(getWidth() / 2 - 50, 5 * getHeight() / 6 - 25, 100, 50);
+
+    // Set GBA controls' positions on GUI
+    GBASampleRateSlider.setBounds(getWidth() / 2 - 100, 4 * getHeight() / 6 - 50, 200, 100);
 }
 
 // From [1] Function to called if parameter value has changed
@@ -157,6 +238,12 @@ void ProjectCodeAudioProcessorEditor::timerCallback()
             SNESBitDepthSlider.setVisible(false);
             SNESSampleRateSlider.setVisible(false);
             SNESDPCMSlider.setVisible(false);
+            SNESModeSelector.setVisible(false);
+
+            GBSampleRateSlider.setVisible(false);
+            GBVolumeSelector.setVisible(false);
+
+            GBASampleRateSlider.setVisible(false);
         }
 
         // If SNES, make SNES controls visible, and other console specific controls invisible
@@ -166,9 +253,17 @@ void ProjectCodeAudioProcessorEditor::timerCallback()
             NESSampleRateSlider.setVisible(false);
             PCMorDPCMSelector.setVisible(false);
 
-            SNESBitDepthSlider.setVisible(true);
+            // The bit depth and DPCM sliders aren't used when encoding BRR blocks
+            bool BRR = SNESModeSelector.getSelectedItemIndex() == 1;
+            SNESBitDepthSlider.setVisible(!BRR);
             SNESSampleRateSlider.setVisible(true);
-            SNESDPCMSlider.setVisible(true);
+            SNESDPCMSlider.setVisible(!BRR);
+            SNESModeSelector.setVisible(true);
+
+            GBSampleRateSlider.setVisible(false);
+            GBVolumeSelector.setVisible(false);
+
+            GBASampleRateSlider.setVisible(false);
         }
 
         // If GameBoy, make GameBoy controls visible, and other console specific controls invisible
@@ -181,6 +276,12 @@ void ProjectCodeAudioProcessorEditor::timerCallback()
             SNESBitDepthSlider.setVisible(false);
             SNESSampleRateSlider.setVisible(false);
             SNESDPCMSlider.setVisible(false);
+            SNESModeSelector.setVisible(false);
+
+            GBSampleRateSlider.setVisible(true);
+            GBVolumeSelector.setVisible(true);
+
+            GBASampleRateSlider.setVisible(false);
         }
 
         // If GBA, make GBA controls visible, and other console specific controls invisible
@@ -193,6 +294,12 @@ void ProjectCodeAudioProcessorEditor::timerCallback()
             SNESBitDepthSlider.setVisible(false);
             SNESSampleRateSlider.setVisible(false);
             SNESDPCMSlider.setVisible(false);
+            SNESModeSelector.setVisible(false);
+
+            GBSampleRateSlider.setVisible(false);
+            GBVolumeSelector.setVisible(false);
+
+            GBASampleRateSlider.setVisible(true);
         }
 
         // Check that there is a sample loaded into the VST
@@ -202,6 +309,37 @@ void ProjectCodeAudioProcessorEditor::timerCallback()
             audioProcessor.updateSample(audioProcessor.getRange()); // Update the sample based on these parameters 
         }
     }
+
+    // A sample over the length held in memory is streamed, and its wave RAM or Direct Sound levels are played as plain sample data,
+    // so say so on the consoles that would otherwise play them through the wave channel or the mixer, (checked every tick, as
+    // loading a sample doesn't change any parameter)
+    juce::String streamedNote;
+    if (audioProcessor.isSampleStreamed())
+    {
+        juce::String item = consoleSelector.getItemText(consoleSelector.getSelectedItemIndex());
+
+        if (item == "GameBoy")
+        {
+            streamedNote = "Samples over 10 seconds are streamed from disk: the wave RAM levels are kept, but the sample is played directly rather than through the wave channel";
+        }
+        else if (item == "GBA")
+        {
+            streamedNote = "Samples over 10 seconds are streamed from disk: the 8 bit levels are kept, but the sample is played directly rather than through the Direct Sound mixer";
+        }
+    }
+
+    if (streamedNote != streamedNoteLabel.getText())
+    {
+        streamedNoteLabel.setText(streamedNote, juce::dontSendNotification);
+        streamedNoteLabel.setVisible(streamedNote.isNotEmpty());
+    }
+
+    // Redraw the performance counters a few times a second while they are shown
+    if (performanceToggle.getToggleState() && ++performanceRefreshCounter >= 15)
+    {
+        performanceRefreshCounter = 0;
+        repaint(performanceArea);
+    }
 }
 
 //Drag File from [2]
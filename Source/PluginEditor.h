@@ -77,9 +77,19 @@ private:
 
     // From [2]
     juce::TextButton loadButton{ "Drag and Drop or Click to Select an Audio File to be Sampled" };  // A button to bring up file selector for an audio sample to be selected
+    juce::TextButton exportButton{ "Click to Export the Processed Sample to an Audio File" };       // A button to bring up file selector for the processed sample to be exported to
+    juce::TextButton exportDMCButton{ "Click to Export the Sample as NES DMC Data (.dmc)" };         // A button to bring up file selector for the DMC encoded sample to be exported to
+
+    // Performance overlay
+    juce::ToggleButton performanceToggle{ "Performance" };  // Shows or hides the performance counters
+    juce::Rectangle<int> performanceArea;                   // Where the performance counters are drawn
+    int performanceRefreshCounter = 0;                      // Timer ticks since the performance counters were last redrawn
+
+    juce::Label streamedNoteLabel;                          // Says how a streamed sample is played differently on the GameBoy and GBA
     
     // General controls
-    juce::ComboBox consoleSelector, sampleMIDINoteSelector;
+    juce::ComboBox consoleSelector, sampleMIDINoteSelector, modeSelector, voiceStealingSelector, pitchVariantsSelector;
+    juce::Slider numVoicesSlider;
 
     // NES Controls
     juce::Slider NESBitDepthSlider, NESSampleRateSlider;
@@ -87,10 +97,14 @@ private:
 
     // SNES Controls
     juce::Slider SNESBitDepthSlider, SNESSampleRateSlider, SNESDPCMSlider;
+    juce::ComboBox SNESModeSelector;
 
     // GB Controls
+    juce::Slider GBSampleRateSlider;
+    juce::ComboBox GBVolumeSelector;
 
     // GBA Controls
+    juce::Slider GBASampleRateSlider;
 
     // From [1]
     using APVTS = juce::AudioProcessorValueTreeState;
@@ -98,7 +112,10 @@ private:
 
     // Attachments to be used to attach parameters to controls
     juce::AudioProcessorValueTreeState::ComboBoxAttachment consoleSelectorAttachment, sampleMIDINoteSelectorAttachment, PCMorDPCMSelectorAttachment;
-    juce::AudioProcessorValueTreeState::SliderAttachment NESBitDepthSliderAttachment, NESSampleRateSliderAttachment, SNESBitDepthSliderAttachment, SNESSampleRateSliderAttachment, SNESDPCMSliderAttachment;
+
+    // Made once each combo box has its items, as an attachment selects the parameter's saved value as soon as it is made
+    std::unique_ptr<juce::AudioProcessorValueTreeState::ComboBoxAttachment> modeSelectorAttachment, voiceStealingSelectorAttachment, pitchVariantsSelectorAttachment, SNESModeSelectorAttachment, GBVolumeSelectorAttachment;
+    juce::AudioProcessorValueTreeState::SliderAttachment NESBitDepthSliderAttachment, NESSampleRateSliderAttachment, SNESBitDepthSliderAttachment, SNESSampleRateSliderAttachment, SNESDPCMSliderAttachment, GBSampleRateSliderAttachment, GBASampleRateSliderAttachment, numVoicesSliderAttachment;
 
     JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (ProjectCodeAudioProcessorEditor)
 };
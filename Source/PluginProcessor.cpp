@@ -35,6 +35,9 @@
 
 #include "PluginProcessor.h"
 #include "PluginEditor.h"
+#include "CrushKernels.h"
+#include "CrushPipeline.h"
+#include "HoldValueReader.h"
 
 //==============================================================================
 ProjectCodeAudioProcessor::ProjectCodeAudioProcessor()
@@ -52,17 +55,44 @@ ProjectCodeAudioProcessor::ProjectCodeAudioProcessor()
     // From [2], set to register basic formats!
     formatManager.registerBasicFormats();
 
-    // From [2]. Adds the correct number of voices to the sampler
-    for (int i = 0; i < numVoices; i++)
+    // From [2]. Adds the maximum number of voices to the sampler, so the polyphony can be changed without allocating
+    for (int i = 0; i < maxNumVoices; i++)
     {
-        sampler.addVoice(new juce::SamplerVoice());
+        auto* voice = new CrushedVoice();
+        voice->setStreamRing(streamer.getRing(i));  // Each voice gets its own read-ahead window for streamed samples
+        sampler.addVoice(voice);
     }
+
+    // Look each parameter up by ID once, so reading them every block is just an atomic load
+    parameterHandles.console = apvts.getRawParameterValue("Console");
+    parameterHandles.sampleMIDINote = apvts.getRawParameterValue("SampleMidiNote");
+    parameterHandles.PCMorDPCM = apvts.getRawParameterValue("PCMorDPCM");
+    parameterHandles.mode = apvts.getRawParameterValue("Mode");
+    parameterHandles.voices = apvts.getRawParameterValue("Voices");
+    parameterHandles.voiceStealing = apvts.getRawParameterValue("VoiceStealing");
+    parameterHandles.pitchVariants = apvts.getRawParameterValue("PitchVariants");
+
+    // And each console's controls, by the IDs in its profile
+    ConsoleProfiles::forEachProfile([&](auto profile)
+    {
+        using Profile = decltype(profile);
+        auto& controls = parameterHandles.consoles[(int)Profile::console];
+
+        auto getControl = [&](const char* parameterID) { return parameterID != nullptr ? apvts.getRawParameterValue(parameterID) : nullptr; };
+
+        controls.bitDepth = getControl(Profile::bitDepthID);
+        controls.sampleRate = getControl(Profile::sampleRateID);
+        controls.mode = getControl(Profile::modeID);
+        controls.slopeBitDepth = getControl(Profile::slopeBitDepthID);
+        controls.volumeShift = getControl(Profile::volumeShiftID);
+    });
+
+    streamer.startThread(); // Start the disk streamer, which idles until a streamed sample is played
+    renderer.startThread(); // Start the background renderer, which waits until a sample needs processing
 }
 
 ProjectCodeAudioProcessor::~ProjectCodeAudioProcessor()
 {
-    // From [2]. Destroy formatReader object upon closing to ensure no leaking
-    formatReader = nullptr;
 }
 
 //==============================================================================
@@ -136,6 +166,8 @@ void ProjectCodeAudioProcessor::prepareToPlay (double sampleRate, int samplesPer
     // From [2] initialise sampler's sample rate and parameters before playback 
     sampler.setCurrentPlaybackSampleRate(sampleRate);
 
+    liveCrusher.prepare(sampleRate, getTotalNumInputChannels());   // Set up the real time bit crusher for the incoming audio
+
     getAndSetParams();
 }
 
@@ -173,6 +205,8 @@ bool ProjectCodeAudioProcessor::isBusesLayoutSupported (const BusesLayout& layou
 
 void ProjectCodeAudioProcessor::processBlock (juce::AudioBuffer<float>& buffer, juce::MidiBuffer& midiMessages)
 {
+    const auto blockStartTicks = juce::Time::getHighResolutionTicks();   // Time the whole block for the performance counters
+
     juce::ScopedNoDenormals noDenormals;
     auto totalNumInputChannels  = getTotalNumInputChannels();
     auto totalNumOutputChannels = getTotalNumOutputChannels();
@@ -188,6 +222,19 @@ void ProjectCodeAudioProcessor::processBlock (juce::AudioBuffer<float>& buffer,
 
     getAndSetParams();  // Update parameters as program goes
 
+    renderer.swapInNextSound(sampler);  // Pick up the newly processed sample, if one has finished rendering
+
+    // Set the polyphony and how voices are stolen once they are all in use
+    sampler.setVoiceLimit(params.numVoices);
+    sampler.setStealingPolicy(params.stealQuietest ? CrushedSynthesiser::StealingPolicy::quietestVoice
+                                                   : CrushedSynthesiser::StealingPolicy::oldestNote);
+
+    // Run the Direct Sound mixer at the GBA's mixing rate, (voices still playing a GBA sound after a console change keep the last one)
+    if (params.directSound)
+    {
+        sampler.setDirectSoundMixRate(params.sampleRate);
+    }
+
     // This is the place where you'd normally do the guts of your plugin's
     // audio processing...
     // Make sure to reset the state if your inner loop is processing
@@ -195,18 +242,23 @@ void ProjectCodeAudioProcessor::processBlock (juce::AudioBuffer<float>& buffer,
     // Alternatively, you can process the samples with the channels
     // interleaved by keeping the same state.
 
-    for (int channel = 0; channel < totalNumInputChannels; ++channel)
+    // In effect mode, the incoming audio is bit crushed in real time with the same console emulation as the sample.
+    // Each channel's state carries over from one block to the next, so the processing is seamless between blocks
+    if (params.effectMode)
     {
-        auto* channelData = buffer.getWritePointer (channel);
-
-        // ..do something to the data...
-
-        // In this plugin's case, the data is processed separately, as processing
-        // takes place on only the initial sample data, not the output of the plugin
+        liveCrusher.process(buffer, totalNumInputChannels, params);
+    }
+    else
+    {
+        liveCrusher.reset();    // Start afresh when effect mode is next turned on
     }
 
     // From [2]
     sampler.renderNextBlock(buffer, midiMessages, 0, buffer.getNumSamples());
+
+    // Record how much of the block's real time budget was used, (lock-free)
+    performance.addBlockTime(juce::Time::highResolutionTicksToSeconds(juce::Time::getHighResolutionTicks() - blockStartTicks),
+                             getSampleRate() > 0 ? buffer.getNumSamples() / getSampleRate() : 0.0);
 }
 
 //==============================================================================
@@ -250,138 +302,31 @@ void ProjectCodeAudioProcessor::setStateInformation (const void* data, int sizeI
     }
 }
 
-// Function to store the current values of the parameter controls in the parameter object
+// Function to store the current values of the parameter controls in the parameter object. Called at the start of every
+// block, so it only reads the cached parameter handles and looks the rates up in tables, (no strings or allocation)
 void ProjectCodeAudioProcessor::getAndSetParams()
 {
-    int consoleIndex = apvts.getRawParameterValue("Console")->load();   // Get the index of the current Console selected
-    int DPCMIndex;  // Initialised to store index of parameter to choose whether DPCM or PCM is to be used
-
-    // Check the console index
-    switch (consoleIndex)
-    {
-        // If '0' then the console selected is NES
-        case 0:
-            params.console = "NES"; // Store that current console is NES
-            DPCMIndex = apvts.getRawParameterValue("PCMorDPCM")->load();    // Get the index of whether PCM or DPCM is selected
-            // If 0, PCM is selected
-            if (DPCMIndex == 0)
-            {
-                params.DPCM = false;    // Set DPCM to not be emulated, (so PCM will be used instead)
-            }
-            // If 1, DPCM is selected
-            else if (DPCMIndex == 1)
-            {
-                params.DPCM = true;     // Set DPCM to be emulated
-            }
-            break;
-        // If '1' then the console selected is SNES
-        case 1:
-            params.console = "SNES";    // Store that current console is SNES
-            params.DPCM = true;         // Set DPCM to be emulated
-            break;
-        // If '2' then the console selected is GameBoy
-        case 2:
-            params.console = "GameBoy"; // Store that current console is GameBoy
-            break;
-        // If '3' then the console selected is GBA
-        case 3:
-            params.console = "GBA"; // Store that current console is GBA
-            break;
-    }
-    
-    params.sampleMIDINote = apvts.getRawParameterValue("SampleMidiNote")->load();   // Store the currently selected starting MIDI Note
-
-    // Check if the currently selected console is NES
-    if (params.console == "NES")
-    {
-        params.bitDepth = apvts.getRawParameterValue("NESBitDepth")->load();        // Set desired bit depth to the current value of the NES bit depth slider
-        params.DPCMBit = 1;                                                         // Set DPCM parameter to 1 bit
-        int sampleRateIndex = apvts.getRawParameterValue("NESSampleRate")->load();  // Get the currently selected index of the NES sample rate slider
+    auto& handles = parameterHandles;
 
-        // Set desired sample rate to appropriate value according to index
-        switch (sampleRateIndex)
-        {
-        case 0:
-            params.sampleRate = 4177.4;
-            break;
-        case 1:
-            params.sampleRate = 4696.63;
-            break;
-        case 2:
-            params.sampleRate = 5261.41;
-            break;
-        case 3:
-            params.sampleRate = 5579.22;
-            break;
-        case 4:
-            params.sampleRate = 6023.94;
-            break;
-        case 5:
-            params.sampleRate = 7044.94;
-            break;
-        case 6:
-            params.sampleRate = 7917.18;
-            break;
-        case 7:
-            params.sampleRate = 8397.01;
-            break;
-        case 8:
-            params.sampleRate = 9446.63;
-            break;
-        case 9:
-            params.sampleRate = 11233.8;
-            break;
-        case 10:
-            params.sampleRate = 12595.5;
-            break;
-        case 11:
-            params.sampleRate = 14089.9;
-            break;
-        case 12:
-            params.sampleRate = 16965.4;
-            break;
-        case 13:
-            params.sampleRate = 21315.5;
-            break;
-        case 14:
-            params.sampleRate = 25191.0;
-            break;
-        case 15:
-            params.sampleRate = 33252.1;
-            break;
-        }
-    }
-    
-    // If not, check if the currently selected console is SNES
-    else if (params.console == "SNES")
-    {
-        params.bitDepth = apvts.getRawParameterValue("SNESBitDepth")->load();       // Set desired bit depth to the current value of the SNES bit depth slider
-        params.DPCMBit = apvts.getRawParameterValue("SNESDPCMBit")->load();         // Set desired DPCM bit number to the current value of the SNES DPCM bit slider
-        int sampleRateIndex = apvts.getRawParameterValue("SNESSampleRate")->load(); // Get the currently selected index of the SNES sample rate slider
-        
-        // For now just set sample rate to 32kHz for either index. To be changed after further research
-        switch (sampleRateIndex)
-        {
-        case 0:
-            params.sampleRate = 32000.0;
-            break;
-        case 1:
-            params.sampleRate = 32000.0;
-            break;
-        }
-    }
+    params.console = (Console)juce::jlimit(0, ConsoleTables::numConsoles - 1, (int)handles.console->load());    // Store the currently selected console
+    params.sampleMIDINote = (int)handles.sampleMIDINote->load();        // Store the currently selected starting MIDI Note
+    params.effectMode = (int)handles.mode->load() == 1;                 // Store whether the incoming audio is to be bit crushed too
+    params.numVoices = (int)handles.voices->load();                     // Store the number of notes that can be played at once
+    params.stealQuietest = (int)handles.voiceStealing->load() == 1;     // Store whether the quietest voice is stolen rather than the oldest note
+    params.pitchVariants = (int)handles.pitchVariants->load() == 1;     // Store whether octaves of the processed sample are pre-rendered
 
-    // If not, check if the currently selected console is GameBoy
-    else if (params.console == "GameBoy")
+    // The console's own controls, read through its profile
+    ConsoleProfiles::visit(params.console, [&](auto profile)
     {
+        using Profile = decltype(profile);
+        const auto& controls = handles.consoles[(int)Profile::console];
 
-    }
-
-    // If not, check if the currently selected console is GBA
-    else if (params.console == "GBA")
-    {
+        // A setting the console fixes has no control, so takes the profile's value
+        auto load = [](std::atomic<float>* control, int fixedValue) { return control != nullptr ? (int)control->load() : fixedValue; };
 
-    }
+        CrushPipeline<Profile>::setParameters(params, load(controls.mode, 0), load(controls.bitDepth, Profile::minBitDepth), load(controls.sampleRate, 0),
+                                              load(controls.slopeBitDepth, Profile::minSlopeBitDepth), load(controls.volumeShift, 0));
+    });
 }
 
 juce::BigInteger ProjectCodeAudioProcessor::getRange()
@@ -397,14 +342,11 @@ void ProjectCodeAudioProcessor::loadSample()
     // If browsing for a file (so button is pressed)
     if (fileChooser.browseForFileToOpen())
     {
-        sampleFile = fileChooser.getResult();                       // Get the file selected
-        formatReader = formatManager.createReaderFor(sampleFile);   // Create a reader for this file
+        sampleFile = fileChooser.getResult();   // Get the file selected
 
         range.setRange(12, 128, true);  // Set range of MIDI notes
 
-        auto sample = new juce::SamplerSound("Sample", *formatReader, range, params.sampleMIDINote, 0, 0, 10);  // Create a new SamplerSound object from this file using the reader
-
-        originalSampleData = sample->getAudioData();    // Get the data associated with this sound 
+        readOriginalSample();   // Read every channel of the file's audio data
 
         updateSample(range);    // Update VST's sample by processing the original data
     }
@@ -416,16 +358,83 @@ void ProjectCodeAudioProcessor::loadSample(const juce::String& path)
     range.setRange(12, 128, true);  // Set range of MIDI notes
 
     
-    sampleFile = juce::File(path);                              // Get the dropped file as an object
-    formatReader = formatManager.createReaderFor(sampleFile);   // Create a reader for this file
+    sampleFile = juce::File(path);  // Get the dropped file as an object
 
-    auto sample = new juce::SamplerSound("Sample", *formatReader, range, params.sampleMIDINote, 0, 0, 10);  // Create a new SamplerSound object from this file using the reader
-
-    originalSampleData = sample->getAudioData();    // Get the data associated with this sound
+    readOriginalSample();   // Read every channel of the file's audio data
 
     updateSample(range);    // Update VST's sample by processing the original data
 }
 
+// Reads every channel of the sample file's audio data, (up to the maximum sample length), to be used as the original sample data
+void ProjectCodeAudioProcessor::readOriginalSample()
+{
+    PerformanceCounters::ScopedStageTimer timer(performance, PerformanceCounters::Stage::readFile);
+
+    // Uncompressed files (WAV and AIFF) are memory mapped rather than decoded, so loading only maps the file, and the renderer reads
+    // the frames straight from the pages the OS already has cached. Other formats give no mapped reader and are decoded as before
+    std::unique_ptr<juce::MemoryMappedAudioFormatReader> newMappedReader;
+
+    if (auto* format = formatManager.findFormatForFileExtension(sampleFile.getFileExtension()))
+    {
+        newMappedReader.reset(format->createMemoryMappedReader(sampleFile));
+    }
+
+    if (newMappedReader != nullptr && newMappedReader->mapEntireFile()
+        && newMappedReader->lengthInSamples <= (juce::int64)(maxSampleLengthSeconds * newMappedReader->sampleRate))
+    {
+        const juce::ScopedLock sl(sourceLock);              // Make sure the renderer isn't reading the previous sample's data
+        mappedReader = std::move(newMappedReader);          // Replace the previous sample, (unmapping it if it was mapped)
+        originalSampleData.setSize(0, 0);
+        streamedFile = juce::File();
+        sampleStreamed = false;
+        originalSampleBytes = 0;
+        mappedFileBytes = mappedReader->getNumBytesUsed();
+        sampleFileSampleRate = mappedReader->sampleRate;
+        ++sampleGeneration;
+        return;
+    }
+
+    std::unique_ptr<juce::AudioFormatReader> formatReader(formatManager.createReaderFor(sampleFile));  // Create a reader for this file, (only needed while it is read)
+
+    // Check the file could be read
+    if (formatReader == nullptr)
+    {
+        return;
+    }
+
+    auto maxNumSamples = (juce::int64)(maxSampleLengthSeconds * formatReader->sampleRate);
+
+    // A sample longer than the maximum isn't read into memory at all, the renderer processes it from the file to be streamed
+    if (formatReader->lengthInSamples > maxNumSamples)
+    {
+        const juce::ScopedLock sl(sourceLock);
+        originalSampleData.setSize(0, 0);
+        mappedReader = nullptr;
+        streamedFile = sampleFile;
+        sampleStreamed = true;
+        originalSampleBytes = 0;
+        mappedFileBytes = 0;
+        sampleFileSampleRate = formatReader->sampleRate;
+        ++sampleGeneration;
+        return;
+    }
+
+    auto numSamples = (int)formatReader->lengthInSamples;
+
+    juce::AudioSampleBuffer newSampleData((int)formatReader->numChannels, numSamples);  // Buffer with room for every channel in the file
+    formatReader->read(&newSampleData, 0, numSamples, 0, true, true);                   // Read the file's audio data into it
+
+    const juce::ScopedLock sl(sourceLock);                  // Make sure the renderer isn't reading the previous sample's data
+    originalSampleData = std::move(newSampleData);          // Replace the original sample data
+    mappedReader = nullptr;                                 // Nor mapped
+    streamedFile = juce::File();                            // The sample is held in memory, so isn't streamed
+    sampleStreamed = false;
+    originalSampleBytes = (size_t)originalSampleData.getNumChannels() * (size_t)originalSampleData.getNumSamples() * sizeof(float);
+    mappedFileBytes = 0;
+    sampleFileSampleRate = formatReader->sampleRate;        // Store the sample rate of the file
+    ++sampleGeneration;                                     // Mark the renderer's cached stages as out of date
+}
+
 // Function to check if a sample is loaded and return result (true or false)
 bool ProjectCodeAudioProcessor::sampleLoaded()
 {
@@ -442,45 +451,342 @@ bool ProjectCodeAudioProcessor::sampleLoaded()
 // Updates the VST's current sample to a new updated one
 void ProjectCodeAudioProcessor::updateSample(juce::BigInteger range)
 {
-    sampler.clearSounds();  // Remove any sounds stored in the VST
+    // Ask the renderer to process the sample with the current parameters, the sampler picks up the result once it is ready
+    renderer.requestRender(params, range);
+}
+
+// Live memory used by each part of the plugin, (read from each owner, so it can be checked at any time)
+ProjectCodeAudioProcessor::MemoryUsage ProjectCodeAudioProcessor::getMemoryUsage() const
+{
+    MemoryUsage usage;
+
+    // Published when the sample is replaced, so the editor never has to wait on the source lock while the renderer reads the sample
+    usage.originalSample = originalSampleBytes.load();
+    usage.mappedFile = mappedFileBytes.load();
+    usage.renderStages = renderer.getStageBytes();
+    usage.renderCache = renderer.getCacheStats().bytesUsed;
+    usage.pitchVariants = getPitchVariantMemory();
+    usage.streaming = streamer.getMemoryBytes();
+    usage.scratch = ((size_t)dpcmScratchSize.load() + (size_t)holdValuesSize.load()) * sizeof(float);
+
+    return usage;
+}
+
+// Memory used by the pre-rendered octaves of the current processed sample
+size_t ProjectCodeAudioProcessor::getPitchVariantMemory() const
+{
+    auto processedSound = renderer.getLatestSound();
+    return processedSound != nullptr ? processedSound->getPitchVariantBytes() : 0;
+}
+
+// Copies the original sample data and its sample rate, returning which loaded sample it is, (0 if no sample is loaded). A mapped
+// sample is decoded into the destination in full, so this is only for the DMC export, the renderer reads the sample through
+// resampleOriginalSample instead
+int ProjectCodeAudioProcessor::copyOriginalSample(juce::AudioSampleBuffer& destination, double& sampleRate)
+{
+    const juce::ScopedLock sl(sourceLock);  // Stop the original sample from being replaced while it is copied
+
+    if (mappedReader != nullptr)
+    {
+        auto numSamples = (int)mappedReader->lengthInSamples;
+        destination.setSize((int)mappedReader->numChannels, numSamples, false, false, true);
+        mappedReader->read(&destination, 0, numSamples, 0, true, true);
+    }
+    else
+    {
+        destination.makeCopyOf(originalSampleData, true);   // Copy, reusing the destination's memory if it is big enough
+    }
 
-    auto processedSampleData = *originalSampleData;                                                         // Copy the original sample data as a new object
-    bitCrushSample(&processedSampleData, params.sampleRate, params.bitDepth, params.DPCM, params.DPCMBit);  // Process the copy of the audio data
+    sampleRate = sampleFileSampleRate;
 
-    juce::File bitCrushedWavFile = juce::File(sampleFile.getParentDirectory().getChildFile("bitCrushed.wav"));  // Create a new/get the file in the same directory as the original sample file to store the processed audio data
-    auto outputStream = new juce::FileOutputStream(bitCrushedWavFile);  // Create an output stream to allow the data to be output to the file
+    return sampleGeneration.load();
+}
+
+// Works out the hold values of the original sample a block at a time, straight from the mapping if it is mapped, so no full
+// length copy of it is ever made
+int ProjectCodeAudioProcessor::resampleOriginalSample(juce::AudioSampleBuffer& sampleHoldValues, int& numSamples, double& sampleRate, float desiredSampleRate)
+{
+    const juce::ScopedLock sl(sourceLock);  // Stop the original sample from being replaced while it is read
+
+    const int numChannels = mappedReader != nullptr ? (int)mappedReader->numChannels : originalSampleData.getNumChannels();
+    numSamples = mappedReader != nullptr ? (int)mappedReader->lengthInSamples : originalSampleData.getNumSamples();
+    sampleRate = sampleFileSampleRate;
+
+    if (numSamples == 0 || numChannels == 0)
+    {
+        return sampleGeneration.load();
+    }
+
+    // Normalise stage, the gain is worked out from each channel's levels, (scanned straight from the mapping if it is mapped)
+    std::vector<juce::Range<float>> levels((size_t)numChannels);
+    {
+        PerformanceCounters::ScopedStageTimer timer(performance, PerformanceCounters::Stage::normalise);
+
+        if (mappedReader != nullptr)
+        {
+            mappedReader->readMaxLevels(0, numSamples, levels.data(), numChannels);
+        }
+        else
+        {
+            for (int channel = 0; channel < numChannels; channel++)
+            {
+                levels[(size_t)channel] = originalSampleData.findMinMax(channel, 0, numSamples);
+            }
+        }
+    }
+
+    // Resample stage, each block is scaled by the gain as it is read, so the values are the same as those of the whole sample normalised
+    {
+        PerformanceCounters::ScopedStageTimer timer(performance, PerformanceCounters::Stage::resample);
+
+        HoldValueReader reader(numChannels, numSamples, CrushKernels::HoldSections(sampleRate, desiredSampleRate),
+                               CrushKernels::getNormaliseGain(levels.data(), numChannels),
+                               [this, numChannels](juce::AudioSampleBuffer& block, int startSample, int numToRead)
+                               {
+                                   if (mappedReader != nullptr)
+                                   {
+                                       mappedReader->read(&block, 0, numToRead, startSample, true, true);
+                                   }
+                                   else
+                                   {
+                                       for (int channel = 0; channel < numChannels; channel++)
+                                       {
+                                           block.copyFrom(channel, 0, originalSampleData, channel, startSample, numToRead);
+                                       }
+                                   }
+                               });
+        reader.readAll(sampleHoldValues);
+    }
+
+    return sampleGeneration.load();
+}
+
+// Gets the file of a streamed sample and its sample rate, returning which loaded sample it is, (0 if the sample isn't streamed)
+int ProjectCodeAudioProcessor::getStreamedFile(juce::File& file, double& sampleRate)
+{
+    const juce::ScopedLock sl(sourceLock);
+
+    if (streamedFile == juce::File())
+    {
+        return 0;
+    }
+
+    file = streamedFile;
+    sampleRate = sampleFileSampleRate;
+
+    return sampleGeneration.load();
+}
+
+// Writes the current processed sample to a .wav file selected in file browser
+void ProjectCodeAudioProcessor::exportSample()
+{
+    // Suggest a file in the same directory as the original sample file
+    juce::FileChooser fileChooser("Please select where to export the processed sample", 
+                                  sampleFile.getParentDirectory().getChildFile("bitCrushed.wav"), "*.wav");
+
+    // If browsing for a file (so button is pressed)
+    if (fileChooser.browseForFileToSave(true))
+    {
+        exportSample(fileChooser.getResult());
+    }
+}
+
+// Writes the current processed sample to the given .wav file, returns whether this was successful
+bool ProjectCodeAudioProcessor::exportSample(const juce::File& file)
+{
+    PerformanceCounters::ScopedStageTimer timer(performance, PerformanceCounters::Stage::exportFile);
+
+    auto processedSound = renderer.getLatestSound();    // The most recently processed sample
+
+    // Check there is a processed sample to export
+    if (processedSound == nullptr)
+    {
+        return false;
+    }
+
+    auto outputStream = std::make_unique<juce::FileOutputStream>(file);  // Create an output stream to allow the data to be output to the file
 
     // Check the output stream is valid
-    if (outputStream->openedOk())
+    if (!outputStream->openedOk())
+    {
+        return false;
+    }
+
+    // Remove any residual data inside the audio file
+    outputStream->setPosition(0);
+    outputStream->truncate();
+
+    auto processedSampleData = processedSound->getAudioData();  // The processed data to be written
+
+    // A sound built from level codes or wave RAM frames is expanded back to one float per sample to be written
+    juce::AudioSampleBuffer expandedData;
+    if (auto* codes = processedSound->getLevelCodes())
+    {
+        codes->expand(expandedData);
+        processedSampleData = &expandedData;
+    }
+    else if (auto* frames = processedSound->getWaveRAMFrames())
+    {
+        frames->expand(expandedData);
+        processedSampleData = &expandedData;
+    }
+    else if (auto* directSample = processedSound->getDirectSoundSample())
+    {
+        directSample->expand(expandedData);
+        processedSampleData = &expandedData;
+    }
+
+    // Create a new audio format writer to write to the output stream, which takes ownership of the stream if successful
+    writer.reset(wavFormat.createWriterFor(outputStream.get(), processedSound->getSourceSampleRate(), 
+                                           (unsigned int)processedSampleData->getNumChannels(), 16, {}, 0));
+
+    // If the writer is not valid, the stream is still owned (and destroyed) here
+    if (writer == nullptr)
+    {
+        return false;
+    }
+
+    outputStream.release();
+
+    bool written;
+
+    // A streamed sample's codes are only all in its temporary file, so they are expanded from there a block at a time
+    if (auto* streamSource = processedSound->getStreamSource())
+    {
+        constexpr int exportBlockSize = 65536;
+        juce::FileInputStream streamInput(streamSource->getFile());
+        juce::AudioSampleBuffer block(streamSource->getNumChannels(), exportBlockSize);
+        juce::MemoryBlock codeBuffer;
+
+        written = streamInput.openedOk();
+
+        for (juce::int64 position = 0; written && position < streamSource->getLength(); position += exportBlockSize)
+        {
+            const int numSamples = (int)juce::jmin((juce::int64)exportBlockSize, streamSource->getLength() - position);
+            written = streamSource->readSamples(streamInput, position, numSamples, block, codeBuffer)
+                   && writer->writeFromAudioSampleBuffer(block, 0, numSamples);
+        }
+    }
+    else
+    {
+        written = writer->writeFromAudioSampleBuffer(*processedSampleData, 0, processedSound->getLength());  // Write the processed sample data to the output stream, and thus the file
+    }
+    writer = nullptr;   // Destroy writer, flushing the data to the file
+
+    return written;
+}
+
+// Writes the original sample encoded as NES DMC data to a .dmc file selected in file browser
+void ProjectCodeAudioProcessor::exportDMC()
+{
+    juce::FileChooser fileChooser("Please select where to export the DMC sample",
+                                  sampleFile.getParentDirectory().getChildFile(sampleFile.getFileNameWithoutExtension() + ".dmc"), "*.dmc");
+
+    if (fileChooser.browseForFileToSave(true))
+    {
+        exportDMC(fileChooser.getResult());
+    }
+}
+
+// Writes the original sample encoded as NES DMC data to the given .dmc file, returns whether this was successful
+bool ProjectCodeAudioProcessor::exportDMC(const juce::File& file)
+{
+    PerformanceCounters::ScopedStageTimer timer(performance, PerformanceCounters::Stage::exportFile);
+
+    juce::AudioSampleBuffer sampleData;
+    double sourceSampleRate = 0;
+
+    // Check there is an original sample in memory to encode, (a streamed sample is far too long for the DMC anyway)
+    if (copyOriginalSample(sampleData, sourceSampleRate) == 0 || sampleData.getNumSamples() == 0)
+    {
+        return false;
+    }
+
+    // Use the selected NES rate, or the highest DMC rate if another console is selected
+    float DMCSampleRate = params.console == Console::NES ? params.sampleRate
+                                                         : ConsoleProfiles::NES::sampleRates[ConsoleProfiles::NES::numSampleRates - 1];
+
+    auto DMCData = encodeSampleDMC(sampleData, sourceSampleRate, DMCSampleRate);
+
+    return DMCData.getSize() > 0 && file.replaceWithData(DMCData.getData(), DMCData.getSize());
+}
+
+// Encodes sample data as NES DMC data. The data is resampled straight to the DMC rate (rather than held at the source rate), as each
+// DMC sample is a single bit
+juce::MemoryBlock ProjectCodeAudioProcessor::encodeSampleDMC(const juce::AudioSampleBuffer& sampleData, double sourceSampleRate, float DMCSampleRate)
+{
+    const int numSamples = sampleData.getNumSamples();
+    const int numChannels = sampleData.getNumChannels();
+
+    if (numSamples == 0 || numChannels == 0 || sourceSampleRate <= 0 || DMCSampleRate <= 0)
+    {
+        return {};
+    }
+
+    const double increment = sourceSampleRate / DMCSampleRate;  // Source samples per DMC sample
+
+    // The DMC only has one channel, and can only play so many bytes
+    const int numDMCSamples = juce::jmin((int)((numSamples - 1) / increment) + 1, maxDMCBytes * 8);
+
+    juce::HeapBlock<float> DMCRateData((size_t)numDMCSamples);
+    float peak = 0;
+
+    // Mix the channels down to mono at the DMC rate, with the same straight line between samples as the sample rate conversion
+    for (int i = 0; i < numDMCSamples; i++)
     {
-        // Remove any residual data inside the audio file
-        outputStream->setPosition(0);
-        outputStream->truncate();
-        
-        writer.reset(wavFormat.createWriterFor(outputStream, 44100.0, 1, 16, {}, 0));   // Create a new audio format writer (overwriting any previous) to write to the output stream 
+        double position = i * increment;
+        int index = (int)position;
+        int nextIndex = juce::jmin(index + 1, numSamples - 1);
+        float alpha = (float)(position - index);
 
-        // If the writer is valid/exists
-        if (writer != nullptr)
+        float mixed = 0;
+        for (int channel = 0; channel < numChannels; channel++)
         {
-            writer->writeFromAudioSampleBuffer(processedSampleData, 0, processedSampleData.getNumSamples());    // Write the processed sample data to the output stream, and thus the file
+            const float* channelData = sampleData.getReadPointer(channel);
+            mixed += channelData[index] + alpha * (channelData[nextIndex] - channelData[index]);
         }
 
-        outputStream->flush();  // Ensure all data is written
-        writer = nullptr;       // Destroy writer
+        DMCRateData[i] = mixed / (float)numChannels;
+        peak = juce::jmax(peak, std::abs(DMCRateData[i]));
+    }
+
+    // Normalise so the loudest point reaches the top or bottom of the counter's range
+    if (peak > 0)
+    {
+        juce::FloatVectorOperations::multiply(DMCRateData.get(), 1.0f / peak, numDMCSamples);
+    }
+
+    // The hardware plays 16 * L + 1 bytes, so pad out to the next length it can play with alternating bits, (which hold the level)
+    const int numBytes = (numDMCSamples + 7) / 8;
+    const int numPlayedBytes = ((numBytes - 1 + 15) / 16) * 16 + 1;
+
+    juce::MemoryBlock DMCData((size_t)numPlayedBytes);
+    auto* bytes = static_cast<juce::uint8*>(DMCData.getData());
+
+    CrushKernels::encodeDMC(DMCRateData.get(), numDMCSamples, DMCStartCounter, bytes);
 
-        formatReader = formatManager.createReaderFor(bitCrushedWavFile);                                                        // Read new audio file
-        sampler.addSound(new juce::SamplerSound("BitCrushedSample", *formatReader, range, params.sampleMIDINote, 0, 0, 10));    // Add to sampler
+    for (int i = numBytes; i < numPlayedBytes; i++)
+    {
+        bytes[i] = 0xaa;
     }
+
+    return DMCData;
 }
 
 // Higher level bit crush function for processing the sample data
-void ProjectCodeAudioProcessor::bitCrushSample(juce::AudioBuffer<float>* sampleData, float desiredSampleRate, int desiredBitDepth, bool DPCM, int DPCMDepth)
+void ProjectCodeAudioProcessor::bitCrushSample(juce::AudioBuffer<float>* sampleData, double sourceSampleRate, float desiredSampleRate, int desiredBitDepth, bool DPCM, int DPCMDepth, bool BRR)
 {
-    convertSampleSampleRate(sampleData, desiredSampleRate); // Convert the sample rate of the given data to the specified value
+    normaliseSample(sampleData);                                                // Make the peak level across every channel equal to 1
+    convertSampleSampleRate(sampleData, sourceSampleRate, desiredSampleRate);   // Convert the sample rate of the given data to the specified value
+    // BRR blocks set their own resolution, so the bit depth parameters aren't used
+    if (BRR)
+    {
+        convertSampleBRR(sampleData, sourceSampleRate, desiredSampleRate);
+    }
     // Check whether sampling method to emulate is DPCM
-    if (DPCM)
+    else if (DPCM)
     {
-        convertSampleBitDepthDPCM(sampleData, desiredSampleRate, desiredBitDepth, DPCMDepth);   // If DPCM, convert audio bit depth according to DPCM parameters
+        convertSampleBitDepthDPCM(sampleData, sourceSampleRate, desiredSampleRate, desiredBitDepth, DPCMDepth);   // If DPCM, convert audio bit depth according to DPCM parameters
     }
     else
     {
@@ -488,177 +794,360 @@ void ProjectCodeAudioProcessor::bitCrushSample(juce::AudioBuffer<float>* sampleD
     }
 }
 
-// Sample rate conversion function which effectively converts sample rate by locking sample values for a certain section to the first value in that setion
-void ProjectCodeAudioProcessor::convertSampleSampleRate(juce::AudioBuffer<float>* sampleData, float desiredSampleRate)
+// Bit crush through the console's pipeline, writing the quantised levels back over the data
+void ProjectCodeAudioProcessor::bitCrushSample(juce::AudioBuffer<float>* sampleData, double sourceSampleRate, const Parameters& crushParams)
 {
-    int numSamples = sampleData->getNumSamples();   // Get the number of samples in the data
+    const int numChannels = sampleData->getNumChannels();
+    const int numSamples = sampleData->getNumSamples();
 
-    float increment = getSampleRate() / desiredSampleRate;  // Calculate the number of samples between each 'sample' (i.e. the size of each section in samples)
+    normaliseSample(sampleData);
 
-    float currPos = 0;  // Set the starting position to the start of the data (sample indexed 0)
+    juce::AudioSampleBuffer sampleHoldValues;
+    getSampleHoldValues(*sampleData, sourceSampleRate, crushParams.sampleRate, sampleHoldValues);
 
-    float currSample;   // Variable to register the value of the current sample (i.e. amplitude value)
-
-    // While the current position remains within the size of the sample data
-    while (currPos <= numSamples-1)
+    // Wave RAM frames and Direct Sound samples are mono and at the emulated rate, so each of their samples is held over its
+    // section of every channel
+    if (crushParams.waveRAM || crushParams.directSound)
     {
-        // If curr pos is a whole number just equate the samples
-        if (floor(currPos) == currPos)
-        {
-            currSample = sampleData->getSample(0, currPos);
-        }
+        std::shared_ptr<WaveRAMFrames> frames;
+        std::shared_ptr<DirectSoundSample> directSample;
 
-        // If not then find the value it would be between the samples in question
-        else
+        if (crushParams.waveRAM)
         {
-            float previousSample = sampleData->getSample(0, (int)floor(currPos));   // Value of the previous actual sample
-            float followingSample = sampleData->getSample(0, (int)ceil(currPos));   // Value of the following actual sample
-            currSample = previousSample + (currPos - floor(currPos)) * (followingSample - previousSample);  // Assume a straight line between samples for now for simplicity's sake to calculate effective 'sample' value
+            frames = encodeSampleWaveRAM(sampleHoldValues, crushParams.volumeShift);
         }
-        
-        // Fill samples between current and the one up to next increment with calculated value
-        // If the current position plus the increment would exceed bounds of data, just go up to the final sample in the data
-        if (currPos + increment > numSamples-1)
+        else
         {
-            for (int i = ceil(currPos); i < numSamples; i++)
-            {
-                sampleData->setSample(0, i, currSample);
-            }
+            directSample = encodeSampleDirectSound(sampleHoldValues);
         }
 
-        // Else go right up to the next increment point
-        else
+        const juce::int64 numEmulatedSamples = frames != nullptr ? frames->getNumSamples() : directSample->getNumSamples();
+        const CrushKernels::HoldSections sections(sourceSampleRate, crushParams.sampleRate);
+
+        for (int channel = 0; channel < numChannels; channel++)
         {
-            for (int i = ceil(currPos); i < currPos + increment; i++)
+            float* channelData = sampleData->getWritePointer(channel);
+
+            for (int i = 0; i < numSamples; i++)
             {
-                sampleData->setSample(0, i, currSample);
+                const auto index = juce::jmin((juce::int64)sections.getSection(i), numEmulatedSamples - 1);
+                channelData[i] = frames != nullptr ? frames->getSample(index) : directSample->getSample(index);
             }
         }
 
-        currPos += increment;   // Set new current position
+        return;
     }
+
+    auto codes = crushParams.BRR ? quantiseSampleCodesBRR(sampleHoldValues, numSamples, sourceSampleRate, crushParams.sampleRate)
+                                 : quantiseSampleCodes(sampleHoldValues, numSamples, sourceSampleRate, crushParams.console, crushParams.sampleRate,
+                                                       crushParams.bitDepth, crushParams.DPCM, crushParams.DPCMBit);
+
+    codes->expand(*sampleData);
+    sampleData->setSize(numChannels, numSamples, true, false, true);   // Drop the padding expand() adds for the voice
 }
 
-// Convert Bit Depth Using DPCM and scale max or min values to 1 or -1
-void ProjectCodeAudioProcessor::convertSampleBitDepthDPCM(juce::AudioBuffer<float>* sampleData, float sampleRateConverted, int desiredBitDepth, int slopeBitDepth)
+// Works out the value each section of the data is held at, (the same values convertSampleSampleRate fills the sections with)
+void ProjectCodeAudioProcessor::getSampleHoldValues(const juce::AudioSampleBuffer& sampleData, double sourceSampleRate, float desiredSampleRate, juce::AudioSampleBuffer& sampleHoldValues)
 {
-    int numSamples = sampleData->getNumSamples();                   // Get the number of samples in the data
-    auto sampleValRange = sampleData->findMinMax(0, 0, numSamples); // Get the minimum and maximum values contained in the sample data
-    auto sampleMaxVal = sampleValRange.getEnd();                    // Max
-    auto sampleMinVal = sampleValRange.getStart();                  // Min
+    PerformanceCounters::ScopedStageTimer timer(performance, PerformanceCounters::Stage::resample);
 
-    sampleData->applyGain(1 / abs(sampleMaxVal));   // Make the absolute value of the maximum or minimum of the original data (whichever is bigger) equal to 1
+    const int numSamples = sampleData.getNumSamples();
+    const CrushKernels::HoldSections sections(sourceSampleRate, desiredSampleRate);
+    const int numSections = sections.getNumSections(numSamples);
 
-    float numMagnitudeValues = pow(2, desiredBitDepth);   // Calculate number of discrete amplitude values (2 to the power of desired bit depth)
-    float maxVal = 1;                                   // Maximum amplitude value set to 1
-    float minVal = -1 + 1 / (0.5 * numMagnitudeValues); // Minimum set to -1 plus one amplitude value increment
+    sampleHoldValues.setSize(sampleData.getNumChannels(), numSections, false, false, true);
 
-    float magIncrement = (maxVal - minVal) / (numMagnitudeValues - 1);  // Get the amplitude value increment (i.e. the gap between values)
-    
-    int numSlopeVals = pow(2, slopeBitDepth);   // Number of possible amplitude increments that can occur from one sample to the next
+    for (int channel = 0; channel < sampleData.getNumChannels(); channel++)
+    {
+        CrushKernels::getHoldValues(sampleData.getReadPointer(channel), numSamples, sections, numSections, sampleHoldValues.getWritePointer(channel));
+    }
+}
+
+// Sample rate conversion function which effectively converts sample rate by locking sample values for a certain section to the value at the start of that section
+void ProjectCodeAudioProcessor::convertSampleSampleRate(juce::AudioBuffer<float>* sampleData, double sourceSampleRate, float desiredSampleRate)
+{
+    PerformanceCounters::ScopedStageTimer timer(performance, PerformanceCounters::Stage::resample);
+
+    int numSamples = sampleData->getNumSamples();       // Get the number of samples in the data
+    int numChannels = sampleData->getNumChannels();     // Get the number of channels in the data
+
+    // The sections are worked out from the exact ratio of the data's own rate to the emulated one, so every boundary is exact
+    // however long the sample is, rather than drifting as adding the increment up in floating point would
+    const CrushKernels::HoldSections sections(sourceSampleRate, desiredSampleRate);
+    const int numSections = sections.getNumSections(numSamples);
+
+    // Make sure the scratch storage is big enough to store the value of every section, (only reallocated for a longer sample)
+    if (holdValuesSize < numSections)
+    {
+        holdValues.malloc((size_t)numSections);
+        holdValuesSize = numSections;
+    }
+
+    // Work out every section's value from the original data first, (assuming a straight line between samples), then fill
+    // each section with its value in one block write
+    for (int channel = 0; channel < numChannels; channel++)
+    {
+        float* channelData = sampleData->getWritePointer(channel);
+
+        CrushKernels::getHoldValues(channelData, numSamples, sections, numSections, holdValues.get());
+        CrushKernels::fillHoldSections(channelData, numSamples, sections, numSections, holdValues.get());
+    }
+}
+
+// Scales every channel by the same gain so the peak level across all of them is 1, (keeping the balance between channels). Done
+// before the sample rate conversion, so the gain comes from the original data's peak, as it does for a streamed sample
+void ProjectCodeAudioProcessor::normaliseSample(juce::AudioBuffer<float>* sampleData)
+{
+    PerformanceCounters::ScopedStageTimer timer(performance, PerformanceCounters::Stage::normalise);
+
+    int numSamples = sampleData->getNumSamples();       // Get the number of samples in the data
+    int numChannels = sampleData->getNumChannels();     // Get the number of channels in the data
+
+    // Get the range of values in each channel of the sample data
+    std::vector<juce::Range<float>> levels((size_t)numChannels);
+    for (int channel = 0; channel < numChannels; channel++)
+    {
+        levels[(size_t)channel] = sampleData->findMinMax(channel, 0, numSamples);
+    }
+
+    // Silence is left as it is, as there is nothing to scale up
+    if (auto gain = CrushKernels::getNormaliseGain(levels.data(), numChannels))
+    {
+        sampleData->applyGain(gain);
+    }
+}
+
+// Convert Bit Depth Using DPCM, (the data should already be normalised)
+void ProjectCodeAudioProcessor::convertSampleBitDepthDPCM(juce::AudioBuffer<float>* sampleData, double sourceSampleRate, float sampleRateConverted, int desiredBitDepth, int slopeBitDepth)
+{
+    PerformanceCounters::ScopedStageTimer timer(performance, PerformanceCounters::Stage::quantise);
+
+    int numSamples = sampleData->getNumSamples();   // Get the number of samples in the data
 
-    // Calculate possible changes in magnitude values (in number of magnitude steps/increments) (e.g. for DPCM bit of 4, this is -2 -1, +1 and +2)
-    juce::Array<int> possibleChangesInMagVals = {};
-    for (int i = -numSlopeVals / 2; i <= numSlopeVals / 2; i++)
+    const CrushKernels::HoldSections sections(sourceSampleRate, sampleRateConverted);   // Get the sections used for sample rate conversion
+    int calcBufferSize = sections.getNumSections(numSamples);                           // Get number of effective samples to be calculated, (one per section)
+
+    // Make sure the scratch storage is big enough to store the calculated values, (only reallocated for a longer sample)
+    if (dpcmScratchSize < calcBufferSize)
     {
-        if (i != 0)
+        dpcmScratch.malloc((size_t)calcBufferSize);
+        dpcmScratchSize = calcBufferSize;
+    }
+
+    // Each effective sample can only move up or down by a limited number of magnitude increments from the one before
+    // (e.g. for DPCM bit of 2, this is -2, -1, +1 and +2), so choose the change which brings the value closest to the
+    // actual one, then assign the calculated values back to the main sampleData buffer. Each channel has its own
+    // DPCM state, starting from 0, and reuses the same scratch storage
+    for (int channel = 0; channel < sampleData->getNumChannels(); channel++)
+    {
+        CrushKernels::encodeDPCM(sampleData->getWritePointer(channel), numSamples, sections, calcBufferSize, desiredBitDepth, slopeBitDepth, dpcmScratch.get());
+    }
+}
+
+// Convert bit depth like PCM by rounding sample values to nearest discrete value according to desired bit depth, (the data should already be normalised)
+void ProjectCodeAudioProcessor::convertSampleBitDepthPCM(juce::AudioBuffer<float>* sampleData, int desiredBitDepth)
+{
+    PerformanceCounters::ScopedStageTimer timer(performance, PerformanceCounters::Stage::quantise);
+
+    int numSamples = sampleData->getNumSamples();   // Get the number of samples in the data
+
+    // Round each sample to the nearest discrete magnitude value, (evenly spaced from -1 plus one increment up to 1, so
+    // for a bit depth of 7, level 63 is 0). The nearest value is calculated directly rather than searched for
+    for (int channel = 0; channel < sampleData->getNumChannels(); channel++)
+    {
+        CrushKernels::quantisePCM(sampleData->getWritePointer(channel), numSamples, desiredBitDepth);
+    }
+}
+
+// Quantise the hold values to level codes, one per emulated sample, (the data they came from should already have been normalised)
+std::shared_ptr<LevelCodes> ProjectCodeAudioProcessor::quantiseSampleCodes(const juce::AudioSampleBuffer& sampleHoldValues, int numSamples, double sourceSampleRate, Console console, float sampleRateConverted, int desiredBitDepth, bool DPCM, int slopeBitDepth)
+{
+    PerformanceCounters::ScopedStageTimer timer(performance, PerformanceCounters::Stage::quantise);
+
+    const CrushKernels::HoldSections sections(sourceSampleRate, sampleRateConverted);  // Get the sections used for sample rate conversion
+    const int numCodes = sampleHoldValues.getNumSamples();                              // One code for each section's value
+
+    auto codes = std::make_shared<LevelCodes>(sampleHoldValues.getNumChannels(), numCodes, desiredBitDepth, sections, numSamples);
+
+    for (int channel = 0; channel < sampleHoldValues.getNumChannels(); channel++)
+    {
+        int DPCMIndex = -1;     // Each channel's DPCM starts from the zero level
+
+        if (codes->hasEightBitCodes())
+        {
+            quantiseChannelCodes(sampleHoldValues.getReadPointer(channel), numCodes, console, desiredBitDepth, DPCM ? slopeBitDepth : 0, codes->getEightBitCodes(channel), DPCMIndex);
+        }
+        else
         {
-            possibleChangesInMagVals.add(i);
+            quantiseChannelCodes(sampleHoldValues.getReadPointer(channel), numCodes, console, desiredBitDepth, DPCM ? slopeBitDepth : 0, codes->getSixteenBitCodes(channel), DPCMIndex);
         }
     }
 
-    int calcBufferSize = floor(numSamples * (sampleRateConverted / getSampleRate()));   // Get size of calculation buffer
-    auto calcBuffer = new juce::AudioSampleBuffer(1, calcBufferSize);                   // Create a buffer which contains the each effective sample by sample value (to store calculated values)
-    
-    float currSample = 0;                       // Set the current sample's value to 0
-    calcBuffer->setSample(0, 0, currSample);    // Set first sample in calculation buffer to 0
+    return codes;
+}
+
+// Quantise values to codes through the kernel the console's pipeline made for this bit depth and slope, if it has one, otherwise
+// through the general kernel
+template <typename CodeType>
+static void quantiseValuesToCodes(const float* values, int numCodes, Console console, int bitDepth, int slopeBitDepth, CodeType* codes, int& DPCMIndex)
+{
+    bool quantised = false;
+    ConsoleProfiles::visit(console, [&](auto profile)
+    {
+        quantised = CrushPipeline<decltype(profile)>::quantiseChannel(values, numCodes, bitDepth, slopeBitDepth, codes, DPCMIndex);
+    });
+
+    if (!quantised)
+    {
+        CrushKernels::encodeLevelCodes(values, numCodes, bitDepth, slopeBitDepth, codes, DPCMIndex);
+    }
+}
+
+void ProjectCodeAudioProcessor::quantiseChannelCodes(const float* values, int numCodes, Console console, int bitDepth, int slopeBitDepth, juce::uint8* codes, int& DPCMIndex)
+{
+    quantiseValuesToCodes(values, numCodes, console, bitDepth, slopeBitDepth, codes, DPCMIndex);
+}
+
+void ProjectCodeAudioProcessor::quantiseChannelCodes(const float* values, int numCodes, Console console, int bitDepth, int slopeBitDepth, juce::uint16* codes, int& DPCMIndex)
+{
+    quantiseValuesToCodes(values, numCodes, console, bitDepth, slopeBitDepth, codes, DPCMIndex);
+}
 
-    float increment = getSampleRate() / sampleRateConverted;    // Get the sample increment used for sample rate conversion
+// Encode the hold values as BRR blocks and decode them again, to level codes with one per emulated sample, (the data they came
+// from should already have been normalised)
+std::shared_ptr<LevelCodes> ProjectCodeAudioProcessor::quantiseSampleCodesBRR(const juce::AudioSampleBuffer& sampleHoldValues, int numSamples, double sourceSampleRate, float sampleRateConverted)
+{
+    PerformanceCounters::ScopedStageTimer timer(performance, PerformanceCounters::Stage::quantise);
+
+    const CrushKernels::HoldSections sections(sourceSampleRate, sampleRateConverted);  // Get the sections used for sample rate conversion
+    const int numCodes = sampleHoldValues.getNumSamples();                              // One code for each section's value
+
+    // The DSP decodes to 15 bit values, each of which is a level of the 16 bit grid, (level i is (i - 32767) / 32768), so
+    // they are kept as 16 bit codes, (apart from the lowest value, which is one level up)
+    auto codes = std::make_shared<LevelCodes>(sampleHoldValues.getNumChannels(), numCodes, 16, sections, numSamples);
 
-    for (int i = 1; i < calcBufferSize; i++)
+    const int numChannels = sampleHoldValues.getNumChannels();
+    const int numBlocks = BRRCodec::getNumBlocks(numCodes);
+
+    // Each channel is encoded on its own, as the SNES would play each through a separate voice
+    auto encodeChannel = [&](int channel)
     {
-        float nextSample = sampleData->getSample(0, ceil(i * increment));
+        std::vector<juce::uint8> blocks((size_t)numBlocks * BRRCodec::bytesPerBlock);
+        std::vector<juce::int16> decoded((size_t)numBlocks * BRRCodec::samplesPerBlock);
+
+        BRRCodec::encode(sampleHoldValues.getReadPointer(channel), numCodes, blocks.data());
+        BRRCodec::decode(blocks.data(), numBlocks, decoded.data());
 
-        float currMagDif;
-        float lowestMagDif = INFINITY;  // Initialise to INFINITY as method works by cycling through and updating the desired converted value for the next sample by checking which is closest to the actual
-        float desiredMagnitude = 0;
-        // Check which possible increase or decrease brings value closest to actual one
-        for (int change : possibleChangesInMagVals)
+        juce::uint16* channelCodes = codes->getSixteenBitCodes(channel);
+        for (int i = 0; i < numCodes; i++)
         {
-            currMagDif = abs(nextSample - (currSample + change * magIncrement));
-            if (currMagDif < lowestMagDif && currSample + change * magIncrement >= minVal && currSample + change * magIncrement <= maxVal)
-            {
-                lowestMagDif = currMagDif;
-                desiredMagnitude = currSample + change * magIncrement;          
-            }
+            channelCodes[i] = (juce::uint16)juce::jmax(0, decoded[(size_t)i] * 2 + 32767);
         }
-        
-        calcBuffer->setSample(0, i, desiredMagnitude);  // Store the desired value of the current sample in the calculation buffer
+    };
 
-        currSample = desiredMagnitude;  // Store the current sample's value
-    }
+    // So the channels are encoded at the same time, every channel after the first on the pool's threads and the first on this one
+    std::atomic<int> channelsLeft{ numChannels - 1 };
+    juce::WaitableEvent finished;
 
-    // Finally, assign calculated values to the main sampleData buffer
-    float currPos = 0;
-    for (int i = 0; i < calcBufferSize; i++)
+    for (int channel = 1; channel < numChannels; channel++)
     {
-        for (int j = ceil(currPos); j < currPos + increment; j++)
+        encoderPool->addJob([&, channel]
         {
-            if (j < sampleData->getNumSamples())
+            encodeChannel(channel);
+
+            if (--channelsLeft == 0)
             {
-                sampleData->setSample(0, j, calcBuffer->getSample(0, i));
+                finished.signal();
             }
-        }
-        currPos += increment;
+        });
+    }
+
+    if (numChannels > 0)
+    {
+        encodeChannel(0);
+    }
+
+    if (numChannels > 1)
+    {
+        finished.wait();
     }
+
+    return codes;
 }
 
-// Convert bit depth like PCM by rounding sample values to nearest discrete value according to desired bit depth
-void ProjectCodeAudioProcessor::convertSampleBitDepthPCM(juce::AudioBuffer<float>* sampleData, int desiredBitDepth)
+// Replace the data with its BRR encoded and decoded values, (the data should already be converted to the emulated sample rate and normalised)
+void ProjectCodeAudioProcessor::convertSampleBRR(juce::AudioBuffer<float>* sampleData, double sourceSampleRate, float sampleRateConverted)
 {
-    int numSamples = sampleData->getNumSamples();                   // Get the number of samples in the data
-    auto sampleValRange = sampleData->findMinMax(0, 0, numSamples); // Get the minimum and maximum values contained in the sample data
-    auto sampleMaxVal = sampleValRange.getEnd();                    // Max
-    auto sampleMinVal = sampleValRange.getStart();                  // Min
+    const int numSamples = sampleData->getNumSamples();
+    const CrushKernels::HoldSections sections(sourceSampleRate, sampleRateConverted);
 
-    sampleData->applyGain(1 / abs(sampleMaxVal));
+    // The value of each section is its first sample, as the sample rate conversion has already held it over the section
+    juce::AudioSampleBuffer sampleHoldValues(sampleData->getNumChannels(), sections.getNumSections(numSamples));
 
-    juce::Array<float> magnitudeValues = {};
-    float numMagnitudeValues = pow(2, desiredBitDepth);   // Calculate number of discrete amplitude values (2 to the power of desired bit depth)
-    float maxVal = 1;                                   // Maximum amplitude value set to 1
-    float minVal = -1 + 1 / (0.5 * numMagnitudeValues); // Minimum set to -1 plus one amplitude value increment
-
-    // Store the possible discrete magnitude values
-    // I want it to be set so the middle sample is 0 (so for bit depth of 7 bit 63 should be 0)
-    for (int i = 0; i < numMagnitudeValues; i++)
+    for (int channel = 0; channel < sampleData->getNumChannels(); channel++)
     {
-        magnitudeValues.add(minVal + (maxVal - minVal) * (i / (numMagnitudeValues - 1)));
+        const float* channelData = sampleData->getReadPointer(channel);
+        float* values = sampleHoldValues.getWritePointer(channel);
+        CrushKernels::HoldSections::Position position;
+
+        for (int i = 0; i < sampleHoldValues.getNumSamples(); i++, sections.advance(position))
+        {
+            values[i] = channelData[juce::jmin(numSamples - 1, sections.getStart(position))];
+        }
     }
 
-    // Cycle through each sample in the data
-    for (int i = 0; i < numSamples; i++)
+    auto codes = quantiseSampleCodesBRR(sampleHoldValues, numSamples, sourceSampleRate, sampleRateConverted);
+
+    for (int channel = 0; channel < sampleData->getNumChannels(); channel++)
     {
-        float currSample = sampleData->getSample(0, i); // Store the current sample's original value
+        codes->expand(channel, 0, numSamples, sampleData->getWritePointer(channel));
+    }
+}
 
-        float currMagDif;   
-        float magToDesiredMagDif = INFINITY;    // Initialise high as programme works by checking which is lowest
-        float desiredMagnitude = INFINITY;      // Initialise
+// Mixes the hold values down to mono, (the data they came from is normalised across every channel, so the mix can't clip)
+void ProjectCodeAudioProcessor::mixHoldValuesToMono(const float* const* values, int numChannels, int numValues, float* mono)
+{
+    for (int i = 0; i < numValues; i++)
+    {
+        float mix = 0.0f;
 
-        // Cycle through each possible magnitude value and find the one which is closest to the original value
-        for (int j = 0; j < numMagnitudeValues; j++)
+        for (int channel = 0; channel < numChannels; channel++)
         {
-            currMagDif = abs(currSample - magnitudeValues[j]);
-            if (currMagDif < magToDesiredMagDif)
-            {
-                magToDesiredMagDif = currMagDif;
-                desiredMagnitude = magnitudeValues[j];
-            }
-
+            mix += values[channel][i];
         }
-        sampleData->setSample(0, i, desiredMagnitude);  // Set the sample to the new magnitude value (the new discrete one closest to the original)
+
+        mono[i] = mix / (float)juce::jmax(1, numChannels);
     }
 }
 
+static std::vector<float> getEmulatedMonoSamples(const juce::AudioSampleBuffer& sampleHoldValues)
+{
+    std::vector<float> emulatedSamples((size_t)sampleHoldValues.getNumSamples());
+    ProjectCodeAudioProcessor::mixHoldValuesToMono(sampleHoldValues.getArrayOfReadPointers(), sampleHoldValues.getNumChannels(),
+                                                   sampleHoldValues.getNumSamples(), emulatedSamples.data());
+    return emulatedSamples;
+}
+
+// Encode the hold values as wave RAM frames, one sample per emulated sample
+std::shared_ptr<WaveRAMFrames> ProjectCodeAudioProcessor::encodeSampleWaveRAM(const juce::AudioSampleBuffer& sampleHoldValues, int volumeShift)
+{
+    PerformanceCounters::ScopedStageTimer timer(performance, PerformanceCounters::Stage::quantise);
+
+    // The wave channel is mono
+    auto emulatedSamples = getEmulatedMonoSamples(sampleHoldValues);
+    return std::make_shared<WaveRAMFrames>(emulatedSamples.data(), (int)emulatedSamples.size(), volumeShift);
+}
+
+// Encode the hold values as 8 bit signed PCM, one sample per tick of the mixing rate
+std::shared_ptr<DirectSoundSample> ProjectCodeAudioProcessor::encodeSampleDirectSound(const juce::AudioSampleBuffer& sampleHoldValues)
+{
+    PerformanceCounters::ScopedStageTimer timer(performance, PerformanceCounters::Stage::quantise);
+
+    // The mixer plays each voice's sample to both Direct Sound channels, so the samples are mono
+    auto emulatedSamples = getEmulatedMonoSamples(sampleHoldValues);
+    return std::make_shared<DirectSoundSample>(emulatedSamples.data(), (int)emulatedSamples.size());
+}
+
 // Adapted from [1] Create the audio parameter layout
 juce::AudioProcessorValueTreeState::ParameterLayout
 ProjectCodeAudioProcessor::createParameterLayout()
@@ -669,6 +1158,10 @@ ProjectCodeAudioProcessor::createParameterLayout()
     layout.add(std::make_unique<juce::AudioParameterChoice>("Console", "Console", juce::StringArray("NES", "SNES", "GameBoy", "GBA"), 0));  // Console selection parameter
     layout.add(std::make_unique<juce::AudioParameterInt>("SampleMidiNote", "SampleMidiNote", 12, 128, 60));                                 // MIDI note of original sample parameter
     layout.add(std::make_unique<juce::AudioParameterChoice>("PCMorDPCM", "PCMorDPCM", juce::StringArray("PCM", "DPCM"), 0));                // PCM or DPCM selection parameter
+    layout.add(std::make_unique<juce::AudioParameterChoice>("Mode", "Mode", juce::StringArray("Sampler", "Effect"), 0));                    // Sampler only or effect mode (bit crush incoming audio too) parameter
+    layout.add(std::make_unique<juce::AudioParameterInt>("Voices", "Voices", 1, maxNumVoices, 1));                                          // Polyphony parameter
+    layout.add(std::make_unique<juce::AudioParameterChoice>("VoiceStealing", "VoiceStealing", juce::StringArray("Oldest", "Quietest"), 0)); // Which voice is stolen when all are in use parameter
+    layout.add(std::make_unique<juce::AudioParameterChoice>("PitchVariants", "PitchVariants", juce::StringArray("Off", "Octaves"), 0));     // Pre-rendered octaves for high notes parameter
 
     // NES parameters
     layout.add(std::make_unique<juce::AudioParameterInt>("NESBitDepth", "NESBitDepth", 1, 7, 7));                                           // NES bit depth parameter
@@ -680,6 +1173,16 @@ ProjectCodeAudioProcessor::createParameterLayout()
     layout.add(std::make_unique<juce::AudioParameterInt>("SNESBitDepth", "SNESBitDepth", 1, 15, 15));                                           // SNES bit depth parameter
     layout.add(std::make_unique<juce::AudioParameterChoice>("SNESSampleRate", "SNESSampleRate", juce::StringArray("32000.0", "32000.0"), 0));   // SNES sample rate parameter
     layout.add(std::make_unique<juce::AudioParameterInt>("SNESDPCMBit", "SNESDPCMBit", 1, 4, 4));                                               // SNES DPCM bits parameter
+    layout.add(std::make_unique<juce::AudioParameterChoice>("SNESMode", "SNESMode", juce::StringArray("DPCM", "BRR"), 0));                      // SNES DPCM or BRR block encoding parameter
+
+    // GameBoy parameters
+    layout.add(std::make_unique<juce::AudioParameterChoice>("GBSampleRate", "GBSampleRate", juce::StringArray("4096.0", "5461.33", "8192.0",     // GameBoy wave channel sample rate parameter
+                                                                                              "10922.7", "16384.0", "21845.3", "32768.0"), 2));
+    layout.add(std::make_unique<juce::AudioParameterChoice>("GBVolume", "GBVolume", juce::StringArray("100%", "50%", "25%"), 0));              // GameBoy wave channel volume shift parameter
+
+    // GBA parameters
+    layout.add(std::make_unique<juce::AudioParameterChoice>("GBASampleRate", "GBASampleRate", juce::StringArray("10512", "13379", "18157", "21024",  // GBA Direct Sound mixing rate parameter
+                                                                                                "31536", "36314", "40137", "42048"), 1));
 
     return layout;
 }
@@ -36,17 +36,12 @@
 #pragma once
 
 #include <JuceHeader.h>
-
-// Adapted from [1]. Used to store the current values of the parameters that the user can control
-struct Parameters
-{
-    juce::String console = "NES";   // The currently selected console's sampking to be emulated
-    bool DPCM = false;              // Whether DPCM is being used
-    int DPCMBit = 1;                // The bit size of the DPCM
-    int sampleMIDINote = 60;        // The MIDI Note the original audio is played at
-    int bitDepth = 16;              // Number of bits that would represent the amplitude to be emulated
-    float sampleRate = 44100;       // Sample rate to be emulated
-};
+#include "Parameters.h"
+#include "CrushedSampler.h"
+#include "SampleRenderer.h"
+#include "LiveCrusher.h"
+#include "PerformanceCounters.h"
+#include "BRRCodec.h"
 
 //==============================================================================
 /**
@@ -104,18 +99,112 @@ public:
     // Function to check if a sample is loaded and return result (true or false)
     bool sampleLoaded();
 
-    // Updates the VST's current sample to a new updated one
+    // Updates the VST's current sample to a new updated one, (rendered in the background)
     void updateSample(juce::BigInteger range);
 
-    // Bit depth conversion functions
-    void convertSampleBitDepthDPCM(juce::AudioBuffer<float>* sampleData, float sampleRateConverted, int desiredBitDepth, int slopeBitDepth);
+    // Copies the original sample data and its sample rate, returning which loaded sample it is (0 if none), (decodes a mapped
+    // sample in full, so only used to export it as DMC data)
+    int copyOriginalSample(juce::AudioSampleBuffer& destination, double& sampleRate);
+
+    // Normalises the original sample and works out the value of each section held at the emulated sample rate, one per
+    // emulated sample for every channel, along with the number of samples and sample rate of the original sample. The
+    // sample is read a block at a time, so it is never copied in full. Returns which loaded sample it is, (0 if none),
+    // (called from the renderer thread)
+    int resampleOriginalSample(juce::AudioSampleBuffer& sampleHoldValues, int& numSamples, double& sampleRate, float desiredSampleRate);
+
+    // Gets the file of a sample too long to be held in memory and its sample rate, returning which loaded sample it is (0 if the
+    // current sample isn't streamed), (called from the renderer thread)
+    int getStreamedFile(juce::File& file, double& sampleRate);
+
+    // Reads streamed samples from the disk for the voices
+    SampleStreamer& getSampleStreamer() noexcept { return streamer; }
+
+    // Whether the current sample is too long to be held in memory, so is streamed from disk, (read without a lock, e.g. by the editor)
+    bool isSampleStreamed() const noexcept { return sampleStreamed.load(); }
+
+    // Which loaded sample the original sample data is, (increases each time a sample is loaded)
+    int getSampleGeneration() const noexcept { return sampleGeneration.load(); }
+
+    // Render cache counters and memory use, and the memory it may use, (for tuning the budget)
+    RenderCache::Stats getRenderCacheStats() const { return renderer.getCacheStats(); }
+    void setRenderCacheBudget(size_t budgetBytes) { renderer.setCacheBudget(budgetBytes); }
+
+    // Memory used by the pre-rendered octaves of the current processed sample, (0 if pitch variants are off)
+    size_t getPitchVariantMemory() const;
+
+    // Live memory used by each part of the plugin, in bytes. Renders are shared between the render stages, the render cache and the
+    // sounds, so the categories can overlap, but none of them grows with the number of loads or edits
+    struct MemoryUsage
+    {
+        size_t originalSample = 0;  // Decoded original sample, (0 if it is memory mapped or streamed)
+        size_t mappedFile = 0;      // Memory mapping of the original sample file, (shared with the OS file cache)
+        size_t renderStages = 0;    // The renderer's resampled and quantised data and pitch variants, and the head of a streamed sample
+        size_t renderCache = 0;     // Recent renders kept in the render cache
+        size_t pitchVariants = 0;   // Pre-rendered octaves of the current processed sample
+        size_t streaming = 0;       // The voices' read-ahead windows for streamed samples
+        size_t scratch = 0;         // Scratch storage for the DPCM calculation
+    };
+    MemoryUsage getMemoryUsage() const;
+
+    // Stage timings and the processBlock histogram, (shown in the editor's overlay, and can be checked from code)
+    PerformanceCounters& getPerformanceCounters() noexcept { return performance; }
+
+    // Writes the current processed sample to a .wav file, either selected in file browser or at the given location
+    void exportSample();
+    bool exportSample(const juce::File& file);
+
+    // Encodes the original sample as NES DMC data and writes it to a .dmc file, either selected in file browser or at the given location
+    void exportDMC();
+    bool exportDMC(const juce::File& file);
+
+    // Encodes sample data as NES DMC data at the given DMC sample rate, (mixed to mono, normalised, and padded to a length the hardware can play)
+    juce::MemoryBlock encodeSampleDMC(const juce::AudioSampleBuffer& sampleData, double sourceSampleRate, float DMCSampleRate);
+
+    // Bit depth conversion functions. The sample rate conversion and quantise functions below all take the rate the data is
+    // at, (the sample file's own rate), so the data is only ever converted once, from that rate to the emulated one
+    void convertSampleBitDepthDPCM(juce::AudioBuffer<float>* sampleData, double sourceSampleRate, float sampleRateConverted, int desiredBitDepth, int slopeBitDepth);
     void convertSampleBitDepthPCM(juce::AudioBuffer<float>* sampleData, int desiredBitDepth);
 
+    // Quantises the hold values, (one per emulated sample, from getSampleHoldValues), to level codes standing for numSamples
+    // samples at the source rate, rather than writing the levels back over every source rate sample. Goes through the
+    // console's crush pipeline where it has one
+    std::shared_ptr<LevelCodes> quantiseSampleCodes(const juce::AudioSampleBuffer& sampleHoldValues, int numSamples, double sourceSampleRate, Console console, float sampleRateConverted, int desiredBitDepth, bool DPCM, int slopeBitDepth);
+
+    // Quantises numCodes values of one channel to codes, (8 bit codes for bit depths up to 8, 16 bit above), the same way as
+    // quantiseSampleCodes. DPCMIndex carries the DPCM on between calls, (-1 before the first), so a streamed sample can be
+    // quantised a block at a time
+    static void quantiseChannelCodes(const float* values, int numCodes, Console console, int bitDepth, int slopeBitDepth, juce::uint8* codes, int& DPCMIndex);
+    static void quantiseChannelCodes(const float* values, int numCodes, Console console, int bitDepth, int slopeBitDepth, juce::uint16* codes, int& DPCMIndex);
+
+    // Encodes the hold values as SNES BRR blocks, and decodes them back to level codes, as the DSP would play them
+    std::shared_ptr<LevelCodes> quantiseSampleCodesBRR(const juce::AudioSampleBuffer& sampleHoldValues, int numSamples, double sourceSampleRate, float sampleRateConverted);
+
+    // Converts the (already resampled) data to what its BRR blocks decode to, in place
+    void convertSampleBRR(juce::AudioBuffer<float>* sampleData, double sourceSampleRate, float sampleRateConverted);
+
+    // Encodes the hold values, mixed to mono, as GameBoy wave RAM frames
+    std::shared_ptr<WaveRAMFrames> encodeSampleWaveRAM(const juce::AudioSampleBuffer& sampleHoldValues, int volumeShift);
+
+    // Encodes the hold values, mixed to mono, as a GBA Direct Sound sample at the mixing rate
+    std::shared_ptr<DirectSoundSample> encodeSampleDirectSound(const juce::AudioSampleBuffer& sampleHoldValues);
+
+    // Mixes numValues hold values of each channel down to mono, as the GameBoy wave channel and the GBA Direct Sound play them
+    static void mixHoldValuesToMono(const float* const* values, int numChannels, int numValues, float* mono);
+
+    // Works out the value of each section of the (normalised) data held at the emulated sample rate, without writing them back
+    void getSampleHoldValues(const juce::AudioSampleBuffer& sampleData, double sourceSampleRate, float desiredSampleRate, juce::AudioSampleBuffer& sampleHoldValues);
+
     // Sample rate conversion function
-    void convertSampleSampleRate(juce::AudioBuffer<float>* sampleData, float desiredSampleRate);
+    void convertSampleSampleRate(juce::AudioBuffer<float>* sampleData, double sourceSampleRate, float desiredSampleRate);
+
+    // Scales every channel so the maximum value across all of them is 1
+    void normaliseSample(juce::AudioBuffer<float>* sampleData);
 
     // Higher level bit crush function for processing the sample data
-    void bitCrushSample(juce::AudioBuffer<float>* sampleData, float desiredSampleRate, int desiredBitDepth, bool DPCM, int DPCMDepth = 0);
+    void bitCrushSample(juce::AudioBuffer<float>* sampleData, double sourceSampleRate, float desiredSampleRate, int desiredBitDepth, bool DPCM, int DPCMDepth = 0, bool BRR = false);
+
+    // As above, with the console's settings, going through its crush pipeline (as the sampler does) rather than the general kernels
+    void bitCrushSample(juce::AudioBuffer<float>* sampleData, double sourceSampleRate, const Parameters& crushParams);
 
     // Reference
     // From [1] AudioProcessorValueTreeState to store the parameters in
@@ -124,19 +213,70 @@ public:
 
 private:
     // Adapted from [2]
-    juce::Synthesiser sampler;                      // Sampler object
-    juce::AudioSampleBuffer* originalSampleData;    // Object containing data of the original, unprocessed sample
-    juce::File sampleFile;                          // The file containing the original sample 
+    CrushedSynthesiser sampler;                             // Sampler object
+    juce::AudioSampleBuffer originalSampleData;             // Object containing data of the original, unprocessed sample (every channel), (empty if it is memory mapped)
+    juce::File sampleFile;                                  // The file containing the original sample 
+    double sampleFileSampleRate{ 44100.0 };                 // The sample rate of the file containing the original sample
+    mutable juce::CriticalSection sourceLock;               // Protects the original sample data while it is being loaded or read by the renderer
+    std::atomic<int> sampleGeneration{ 0 };                 // Increases each time a sample is loaded
+    std::unique_ptr<juce::MemoryMappedAudioFormatReader> mappedReader;  // Maps the sample file if it is uncompressed, instead of decoding it into memory, (protected by sourceLock)
+    juce::File streamedFile;                                // The sample file if it is too long to be held in memory and is streamed instead, (protected by sourceLock)
+    std::atomic<bool> sampleStreamed{ false };              // Whether there is a streamed file, (published for the editor)
+    std::atomic<size_t> originalSampleBytes{ 0 };           // Memory held by the original sample data, (published when it is replaced, so it can be read without the lock)
+    std::atomic<size_t> mappedFileBytes{ 0 };               // Memory mapped for the sample file, (likewise)
+
+    LiveCrusher liveCrusher;                                // Bit crushes the incoming audio in real time when in effect mode
+
+    PerformanceCounters performance;                        // Timings of each processing stage and of processBlock
+
+    juce::HeapBlock<float> dpcmScratch;                     // Scratch storage for the DPCM calculation, reused between renders (only used by the renderer thread)
+    std::atomic<int> dpcmScratchSize{ 0 };                  // Number of values the DPCM scratch storage can hold, (atomic so the memory use can be read)
+    juce::HeapBlock<float> holdValues;                      // Scratch storage for the value of each section of the sample rate conversion, (likewise)
+    std::atomic<int> holdValuesSize{ 0 };                   // Number of values the hold value storage can hold
     juce::BigInteger range;                         // Range of MIDI notes playable by sampler
-    const int numVoices{ 1 };                       // Number of voices (set to one so is monophonic)
+    static constexpr int maxNumVoices{ 32 };        // Number of voices created, (how many are actually used is set by the Voices parameter)
+    static constexpr int maxDMCBytes{ 255 * 16 + 1 };        // Longest DMC sample the hardware can play, ($FF in the sample length register)
+    static constexpr int DMCStartCounter{ 64 };             // Output counter the DMC data starts from, (the middle, usually loaded through $4011)
+    static constexpr double maxSampleLengthSeconds{ 10.0 }; // Longest sample that will be loaded into memory, (longer ones are streamed from disk)
 
     Parameters params;  // Current value of parameters object
 
+    // Cached pointers to each parameter's value, (looked up by ID once in the constructor)
+    struct ParameterHandles
+    {
+        std::atomic<float>* console = nullptr;
+        std::atomic<float>* sampleMIDINote = nullptr;
+        std::atomic<float>* PCMorDPCM = nullptr;
+        std::atomic<float>* mode = nullptr;
+        std::atomic<float>* voices = nullptr;
+        std::atomic<float>* voiceStealing = nullptr;
+        std::atomic<float>* pitchVariants = nullptr;
+
+        // Each console's own controls, indexed by Console, (looked up from the IDs in its profile)
+        struct ConsoleControls
+        {
+            std::atomic<float>* bitDepth = nullptr;         // nullptr if the console's bit depth is fixed
+            std::atomic<float>* sampleRate = nullptr;
+            std::atomic<float>* mode = nullptr;             // nullptr if the console only has one encoding
+            std::atomic<float>* slopeBitDepth = nullptr;    // nullptr if the console's slope bit depth is fixed
+            std::atomic<float>* volumeShift = nullptr;      // nullptr if the console has no volume shift
+        };
+        ConsoleControls consoles[ConsoleTables::numConsoles];
+    };
+    ParameterHandles parameterHandles;
+
+    void readOriginalSample();  // Reads the sample file's audio data to be used as the original sample data
+
     juce::AudioFormatManager formatManager;             // Manages the format of the file and can be used to create a reader
-    juce::AudioFormatReader* formatReader{ nullptr };   // Reads file of a certain format
 
     juce::WavAudioFormat wavFormat;                     // The .wav file format
-    std::unique_ptr<juce::AudioFormatWriter> writer;    // Writer object to write new processed sample to audio wav file
+    std::unique_ptr<juce::AudioFormatWriter> writer;    // Writer object to write the processed sample to an audio wav file when exported
+
+    SampleStreamer streamer{ maxNumVoices };    // Keeps each voice's read-ahead window filled when playing a streamed sample
+
+    juce::SharedResourcePointer<BRRCodec::EncoderPool> encoderPool; // Threads the BRR encoder encodes channels on, (shared by every instance)
+
+    SampleRenderer renderer{ *this };   // Renders the processed sample in the background, (declared last so it is stopped before anything it uses is destroyed)
 
 
     //==============================================================================
@@ -0,0 +1,106 @@
+/*
+  ==================================================================================
+
+    Implementation file for the cache of rendered samples of a JUCE VST video game
+    sample emulation plugin, which keeps the most recently used renders so
+    switching back to a recent console or parameter setting doesn't have to
+    render it again
+
+  ==================================================================================
+*/
+
+#include "RenderCache.h"
+
+//==============================================================================
+RenderCache::RenderCache(size_t budget)
+    : budgetBytes(budget)
+{
+}
+
+const RenderCache::Entry* RenderCache::find(const Key& key)
+{
+    for (auto it = entries.begin(); it != entries.end(); ++it)
+    {
+        if (it->key == key)
+        {
+            entries.splice(entries.begin(), entries, it);   // Move it to the front as the most recently used
+            ++hits;
+            return &entries.front();
+        }
+    }
+
+    ++misses;
+    return nullptr;
+}
+
+void RenderCache::add(const Key& key, Entry entry)
+{
+    entry.key = key;
+    entry.numBytes = entry.codes != nullptr ? entry.codes->getNumBytes() : 0;
+
+    if (entry.waveFrames != nullptr)
+    {
+        entry.numBytes += entry.waveFrames->getNumBytes();
+    }
+
+    if (entry.directSample != nullptr)
+    {
+        entry.numBytes += entry.directSample->getNumBytes();
+    }
+
+    if (entry.data != nullptr)
+    {
+        entry.numBytes += (size_t)entry.data->getNumChannels() * (size_t)entry.data->getNumSamples() * sizeof(float);
+    }
+
+    if (entry.pitchVariants != nullptr)
+    {
+        for (auto& variant : *entry.pitchVariants)
+        {
+            entry.numBytes += (size_t)variant.data->getNumChannels() * (size_t)variant.data->getNumSamples() * sizeof(float);
+        }
+    }
+
+    // A render bigger than the whole budget isn't kept
+    if (entry.numBytes > budgetBytes.load())
+    {
+        return;
+    }
+
+    evictToFit(budgetBytes.load() - entry.numBytes);
+
+    bytesUsed += entry.numBytes;
+    entries.push_front(std::move(entry));
+    numEntries = (int)entries.size();
+}
+
+void RenderCache::setBudget(size_t newBudgetBytes)
+{
+    budgetBytes = newBudgetBytes;
+    evictToFit(newBudgetBytes);
+}
+
+RenderCache::Stats RenderCache::getStats() const
+{
+    Stats stats;
+    stats.hits = hits.load();
+    stats.misses = misses.load();
+    stats.evictions = evictions.load();
+    stats.bytesUsed = bytesUsed.load();
+    stats.budgetBytes = budgetBytes.load();
+    stats.numEntries = numEntries.load();
+    return stats;
+}
+
+void RenderCache::evictToFit(size_t budget)
+{
+    // Any sound still playing a dropped render keeps its own reference to the data, so only the cache's copy goes here
+    while (!entries.empty() && bytesUsed.load() > budget)
+    {
+        bytesUsed -= entries.back().numBytes;
+        entries.pop_back();
+        ++evictions;
+    }
+
+    numEntries = (int)entries.size();
+}
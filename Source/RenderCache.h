@@ -0,0 +1,97 @@
+/*
+  ==================================================================================
+
+    Header file for the cache of rendered samples of a JUCE VST video game sample
+    emulation plugin, which keeps the most recently used renders so switching back
+    to a recent console or parameter setting doesn't have to render it again
+
+  ==================================================================================
+*/
+
+#pragma once
+
+#include <JuceHeader.h>
+#include <list>
+#include "CrushedSampler.h"
+
+//==============================================================================
+/**
+    Least recently used cache of fully rendered (bit crushed) sample data, kept
+    within a memory budget. Only used from the renderer thread, apart from the
+    statistics which can be read from anywhere.
+*/
+class RenderCache
+{
+public:
+    // Everything a render depends on, (the root note and note range aren't included as they don't change the data)
+    struct Key
+    {
+        int sampleGeneration = 0;   // Which loaded sample the data came from, (which also sets the rate it is converted from)
+        float sampleRate = 0;       // Sample rate being emulated
+        bool DPCM = false;          // Whether DPCM is being used
+        int bitDepth = 0;           // Number of bits for the amplitude
+        int DPCMBit = 0;            // The bit size of the DPCM
+        bool pitchVariants = false; // Whether octaves of the data were pre-rendered too
+        bool BRR = false;           // Whether the data was encoded as BRR blocks, (the bit depth and DPCM parameters aren't used if so)
+        bool waveRAM = false;       // Whether the data was encoded as wave RAM frames, (nor are they if so)
+        int volumeShift = 0;        // The wave channel's volume shift, (only used with wave RAM frames)
+        bool directSound = false;   // Whether the data is a Direct Sound sample, (always 8 bit, so the bit depth isn't used either)
+
+        bool operator==(const Key& other) const noexcept
+        {
+            return sampleGeneration == other.sampleGeneration
+                && sampleRate == other.sampleRate && BRR == other.BRR && waveRAM == other.waveRAM && directSound == other.directSound
+                && pitchVariants == other.pitchVariants && (!waveRAM || volumeShift == other.volumeShift)
+                && (BRR || waveRAM || directSound || (DPCM == other.DPCM && bitDepth == other.bitDepth && (!DPCM || DPCMBit == other.DPCMBit)));
+        }
+    };
+
+    // A cached render
+    struct Entry
+    {
+        Key key;                                            // Parameters it was rendered with
+        std::shared_ptr<const juce::AudioSampleBuffer> data;// The rendered data, (with padding after it for the voice)
+        std::shared_ptr<const LevelCodes> codes;            // Or the rendered data as level codes, (only one of these is used)
+        std::shared_ptr<const WaveRAMFrames> waveFrames;    // Or the rendered data as wave RAM frames
+        std::shared_ptr<const DirectSoundSample> directSample;  // Or the rendered data as a Direct Sound sample
+        int length = 0;                                     // Number of samples of actual data
+        double sampleRate = 0;                              // Sample rate the data is played back at
+        std::shared_ptr<const CrushedSound::PitchVariantArray> pitchVariants;  // Pre-rendered octaves of the data, (null if there are none)
+        size_t numBytes = 0;                                // Memory used by the data (or its compact form) and its pitch variants
+    };
+
+    // Counters for tuning the memory budget
+    struct Stats
+    {
+        juce::int64 hits = 0;       // Number of renders found in the cache
+        juce::int64 misses = 0;     // Number of renders that had to be done
+        juce::int64 evictions = 0;  // Number of renders dropped to stay within the budget
+        size_t bytesUsed = 0;       // Memory used by every cached render
+        size_t budgetBytes = 0;     // Most memory the cached renders may use
+        int numEntries = 0;         // Number of cached renders
+    };
+
+    explicit RenderCache(size_t budgetBytes);
+
+    // Returns the cached render for the key (marking it as the most recently used), or nullptr if it isn't cached
+    const Entry* find(const Key& key);
+
+    // Adds a render to the cache under the key, dropping the least recently used ones until it fits in the budget
+    void add(const Key& key, Entry entry);
+
+    // Changes the memory budget, dropping renders if they no longer fit
+    void setBudget(size_t newBudgetBytes);
+
+    Stats getStats() const;
+
+private:
+    void evictToFit(size_t budget);     // Drops the least recently used renders until the cache is within the budget
+
+    std::list<Entry> entries;           // Cached renders, most recently used first
+
+    std::atomic<juce::int64> hits{ 0 }, misses{ 0 }, evictions{ 0 };
+    std::atomic<size_t> bytesUsed{ 0 }, budgetBytes;
+    std::atomic<int> numEntries{ 0 };
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(RenderCache)
+};
@@ -0,0 +1,659 @@
+/*
+  ==================================================================================
+
+    Implementation file for the background renderer of a JUCE VST video game
+    sample emulation plugin. The renderer processes (bit crushes) the sample on
+    its own thread, and hands each newly rendered sound over to the audio thread
+    without the audio thread ever having to wait on a lock or free any memory
+
+  ==================================================================================
+*/
+
+#include "SampleRenderer.h"
+#include "PluginProcessor.h"
+#include "CrushKernels.h"
+#include "HoldValueReader.h"
+
+//==============================================================================
+SampleRenderer::SampleRenderer(ProjectCodeAudioProcessor& p)
+    : juce::Thread("Sample Renderer"), processor(p)
+{
+    streamFormatManager.registerBasicFormats();
+}
+
+SampleRenderer::~SampleRenderer()
+{
+    stopThread(4000);   // Give any render in progress time to finish
+
+    // Drop the reference held by a sound that was never picked up by the audio thread
+    if (auto* unusedSound = pendingSound.exchange(nullptr))
+    {
+        unusedSound->decReferenceCountWithoutDeleting();
+    }
+}
+
+// Asks for the sample to be rendered with the given parameters, only the most recent request is kept
+void SampleRenderer::requestRender(const Parameters& renderParams, const juce::BigInteger& renderRange)
+{
+    {
+        const juce::ScopedLock sl(requestLock);
+        requestedParams = renderParams;
+        requestedRange = renderRange;
+        renderRequested = true;
+    }
+
+    notify();   // Wake the thread up to do the render
+}
+
+// Swaps a newly rendered sound into the sampler, called at the start of each audio block
+void SampleRenderer::swapInNextSound(CrushedSynthesiser& synth)
+{
+    // Take ownership of the pending sound's reference, (so the renderer can no longer drop it)
+    if (auto* newSound = pendingSound.exchange(nullptr))
+    {
+        synth.swapSound(newSound);  // The sampler takes its own reference, the old sound stays alive in the release pool
+
+        // Drop the pending reference, this can never delete the sound as the sampler and release pool still refer to it
+        newSound->decReferenceCountWithoutDeleting();
+    }
+}
+
+CrushedSound::Ptr SampleRenderer::getLatestSound() const
+{
+    const juce::ScopedLock sl(latestSoundLock);
+    return latestSound;
+}
+
+void SampleRenderer::setCacheBudget(size_t budgetBytes)
+{
+    requestedCacheBudget = budgetBytes;
+    notify();
+}
+
+RenderCache::Stats SampleRenderer::getCacheStats() const
+{
+    return renderCache.getStats();
+}
+
+//==============================================================================
+void SampleRenderer::run()
+{
+    while (!threadShouldExit())
+    {
+        Parameters paramsToRender;
+        juce::BigInteger rangeToRender;
+        bool shouldRender;
+
+        // Take the most recent request
+        {
+            const juce::ScopedLock sl(requestLock);
+            shouldRender = renderRequested;
+            renderRequested = false;
+            paramsToRender = requestedParams;
+            rangeToRender = requestedRange;
+        }
+
+        // Apply any change to the cache budget here, as the cache is only touched on this thread
+        if (renderCache.getStats().budgetBytes != requestedCacheBudget.load())
+        {
+            renderCache.setBudget(requestedCacheBudget.load());
+        }
+
+        if (shouldRender)
+        {
+            auto newSound = renderSound(paramsToRender, rangeToRender);
+            updateStageBytes();
+
+            if (newSound != nullptr)
+            {
+                publishSound(newSound);
+            }
+        }
+
+        releaseUnusedSounds();
+
+        // Sleep until another render is requested, waking now and then to free any sounds that have stopped playing
+        if (!shouldRender)
+        {
+            wait(100);
+        }
+    }
+}
+
+// Renders a sound with the given parameters, only redoing the stages whose parameters have changed
+CrushedSound::Ptr SampleRenderer::renderSound(const Parameters& renderParams, const juce::BigInteger& renderRange)
+{
+    // Nothing to render until a sample has been loaded
+    if (processor.getSampleGeneration() == 0)
+    {
+        return nullptr;
+    }
+
+    // A sample too long to be held in memory is rendered to a file to be streamed, (and isn't kept in the render cache)
+    juce::File streamedFile;
+    double streamedFileRate = 0;
+
+    if (int streamedGeneration = processor.getStreamedFile(streamedFile, streamedFileRate))
+    {
+        // Let the in-memory stages go, as the sample they were of has been replaced
+        resampledValues.setSize(0, 0);
+        resampledValid = false;
+        quantisedCodes = nullptr;
+        quantisedWave = nullptr;
+        quantisedDirect = nullptr;
+        pitchVariantData = nullptr;
+
+        return renderStreamedSound(streamedFile, streamedGeneration, renderParams, renderRange);
+    }
+
+    // Let the last streamed render go, as the sample it was of has been replaced
+    streamedSource = nullptr;
+    streamedHead = {};
+    streamValues.setSize(0, 0);
+
+    // A recent render with the same parameters only needs a new sound building around its data
+    RenderCache::Key cacheKey{ processor.getSampleGeneration(), renderParams.sampleRate,
+                               renderParams.DPCM, renderParams.bitDepth, renderParams.DPCMBit, renderParams.pitchVariants, renderParams.BRR,
+                               renderParams.waveRAM, renderParams.volumeShift, renderParams.directSound };
+
+    if (auto* cached = renderCache.find(cacheKey))
+    {
+        return buildSound(*cached, renderParams, renderRange);
+    }
+
+    // Resample and normalise stage, redone if a new sample has been loaded or the rate has changed
+    ResampleKey resampleKey{ processor.getSampleGeneration(), renderParams.sampleRate };
+
+    if (!resampledValid || !(resampleKey == resampledKey))
+    {
+        resampleKey.sampleGeneration = processor.resampleOriginalSample(resampledValues, resampledLength, resampledSourceRate, renderParams.sampleRate);
+
+        // Nothing to render until a sample has been loaded
+        if (resampleKey.sampleGeneration == 0 || resampledLength == 0)
+        {
+            return nullptr;
+        }
+
+        resampledKey = resampleKey;
+        resampledValid = true;
+        quantisedCodes = nullptr;       // Everything after this stage is now out of date
+        quantisedWave = nullptr;
+        quantisedDirect = nullptr;
+    }
+
+    // Quantise stage, redone if the hold values or the bit depth parameters have changed
+    QuantiseKey quantiseKey{ renderParams.DPCM, renderParams.bitDepth, renderParams.DPCMBit, renderParams.BRR,
+                             renderParams.waveRAM, renderParams.volumeShift, renderParams.directSound };
+
+    if ((quantisedCodes == nullptr && quantisedWave == nullptr && quantisedDirect == nullptr) || !(quantiseKey == quantisedKey))
+    {
+        // New codes (or frames) each time, as the previous ones may still be playing. Only one value per emulated sample is quantised
+        quantisedCodes = nullptr;
+        quantisedWave = nullptr;
+        quantisedDirect = nullptr;
+
+        if (renderParams.waveRAM)
+        {
+            quantisedWave = processor.encodeSampleWaveRAM(resampledValues, renderParams.volumeShift);
+        }
+        else if (renderParams.directSound)
+        {
+            quantisedDirect = processor.encodeSampleDirectSound(resampledValues);
+        }
+        else
+        {
+            quantisedCodes = renderParams.BRR
+                ? processor.quantiseSampleCodesBRR(resampledValues, resampledLength, resampledSourceRate, renderParams.sampleRate)
+                : processor.quantiseSampleCodes(resampledValues, resampledLength, resampledSourceRate, renderParams.console, renderParams.sampleRate,
+                                                renderParams.bitDepth, renderParams.DPCM, renderParams.DPCMBit);
+        }
+
+        quantisedKey = quantiseKey;
+        pitchVariantData = nullptr;     // The octaves are now out of date
+    }
+
+    // Pitch variant stage, done the first time they are wanted after the quantised data changes. The octaves are filtered,
+    // so are no longer on the level grid, and are filtered from the codes a chunk at a time. Wave RAM frames have none,
+    // as the wave channel plays other notes by changing its timer rather than its data, and nor do Direct Sound samples, as
+    // the mixer steps through each voice's sample at its own rate
+    if (renderParams.pitchVariants && quantisedCodes != nullptr && pitchVariantData == nullptr)
+    {
+        PerformanceCounters::ScopedStageTimer timer(processor.getPerformanceCounters(), PerformanceCounters::Stage::pitchVariants);
+
+        pitchVariantData = buildPitchVariants(*quantisedCodes, resampledSourceRate);
+    }
+
+    RenderCache::Entry rendered;
+
+    if (quantisedWave != nullptr)
+    {
+        // The frames hold one sample per emulated sample, so play at the wave channel's rate
+        rendered.waveFrames = quantisedWave;
+        rendered.length = quantisedWave->getNumSamples();
+        rendered.sampleRate = renderParams.sampleRate;
+    }
+    else if (quantisedDirect != nullptr)
+    {
+        // One sample per tick of the mixing rate, in the same way
+        rendered.directSample = quantisedDirect;
+        rendered.length = quantisedDirect->getNumSamples();
+        rendered.sampleRate = renderParams.sampleRate;
+    }
+    else
+    {
+        rendered.codes = quantisedCodes;
+        rendered.length = quantisedCodes->getNumSamples();
+        rendered.sampleRate = resampledSourceRate;
+        rendered.pitchVariants = renderParams.pitchVariants ? pitchVariantData : nullptr;
+    }
+
+    // Keep the render for later, (the sample may have been reloaded since the lookup, so use the generation actually rendered)
+    cacheKey.sampleGeneration = resampledKey.sampleGeneration;
+    renderCache.add(cacheKey, rendered);
+
+    // Build sound stage, always done as it only wraps the rendered data with the root note and note range
+    return buildSound(rendered, renderParams, renderRange);
+}
+
+CrushedSound::Ptr SampleRenderer::buildSound(const RenderCache::Entry& rendered, const Parameters& renderParams, const juce::BigInteger& renderRange)
+{
+    PerformanceCounters::ScopedStageTimer timer(processor.getPerformanceCounters(), PerformanceCounters::Stage::buildSound);
+
+    CrushedSound::Ptr newSound;
+
+    if (rendered.waveFrames != nullptr)
+    {
+        newSound = new CrushedSound("BitCrushedSample", rendered.waveFrames, rendered.sampleRate, renderRange, renderParams.sampleMIDINote, 0, 0);
+    }
+    else if (rendered.directSample != nullptr)
+    {
+        newSound = new CrushedSound("BitCrushedSample", rendered.directSample, rendered.sampleRate, renderRange, renderParams.sampleMIDINote, 0, 0);
+    }
+    else if (rendered.codes != nullptr)
+    {
+        newSound = new CrushedSound("BitCrushedSample", rendered.codes, rendered.sampleRate, renderRange, renderParams.sampleMIDINote, 0, 0);
+    }
+    else
+    {
+        newSound = new CrushedSound("BitCrushedSample", rendered.data, rendered.length, rendered.sampleRate, renderRange, renderParams.sampleMIDINote, 0, 0);
+    }
+
+    newSound->setPitchVariants(rendered.pitchVariants);
+
+    return newSound;
+}
+
+// Renders a streamed sample a block at a time, through the same hold values and quantise kernels as a sample held in memory, into a
+// temporary file of level codes. However long the sample is, only a block of it, the block's codes and the head are ever held in memory
+CrushedSound::Ptr SampleRenderer::renderStreamedSound(const juce::File& file, int sampleGeneration, const Parameters& renderParams, const juce::BigInteger& renderRange)
+{
+    RenderCache::Key key{ sampleGeneration, renderParams.sampleRate,
+                          renderParams.DPCM, renderParams.bitDepth, renderParams.DPCMBit, false, renderParams.BRR,
+                          renderParams.waveRAM, renderParams.volumeShift, renderParams.directSound };
+
+    // The same parameters as last time only need a new sound building around the same stream
+    if (streamedSource == nullptr || !(key == streamedKey))
+    {
+        std::unique_ptr<juce::AudioFormatReader> reader(streamFormatManager.createReaderFor(file));
+
+        // The hold sections count samples in ints, as for a sample held in memory
+        if (reader == nullptr || reader->lengthInSamples <= 0 || reader->lengthInSamples > std::numeric_limits<int>::max())
+        {
+            return nullptr;
+        }
+
+        const int numChannels = juce::jmin((int)reader->numChannels, StreamRing::numChannels);  // The voice only plays up to 2 channels
+        const int length = (int)reader->lengthInSamples;
+
+        // Normalise stage, the gain is worked out from the file's levels as the whole sample can't be held at once, (with the
+        // same rule as for a sample held in memory)
+        float gain = 0;
+        {
+            PerformanceCounters::ScopedStageTimer timer(processor.getPerformanceCounters(), PerformanceCounters::Stage::normalise);
+
+            juce::Range<float> levels[StreamRing::numChannels];
+            reader->readMaxLevels(0, length, levels, numChannels);
+            gain = CrushKernels::getNormaliseGain(levels, numChannels);
+        }
+
+        if (gain <= 0)
+        {
+            return nullptr;
+        }
+
+        // The wave channel and Direct Sound are mono, as for a sample held in memory
+        const bool mono = renderParams.waveRAM || renderParams.directSound;
+        const int numCodeChannels = mono ? 1 : numChannels;
+        const CrushKernels::HoldSections sections(reader->sampleRate, renderParams.sampleRate);
+        const int numCodes = sections.getNumSections(length);
+
+        // The level each code stands for. Wave RAM codes are nibbles and Direct Sound codes are the 8 bit signed samples offset
+        // by 128, each played at its output level, and BRR codes index the 16 bit grid, as in quantiseSampleCodesBRR
+        std::vector<float> codeLevels;
+
+        if (renderParams.waveRAM)
+        {
+            const WaveRAMFrames noFrames(nullptr, 0, renderParams.volumeShift);
+            codeLevels.assign(noFrames.getOutputLevels(), noFrames.getOutputLevels() + 16);
+        }
+        else if (renderParams.directSound)
+        {
+            for (int code = 0; code < 256; code++)
+            {
+                codeLevels.push_back((float)(code - 128) / 128.0f);
+            }
+        }
+        else
+        {
+            const int codeBitDepth = renderParams.BRR ? 16 : renderParams.bitDepth;
+            const CrushKernels::PCMLevels grid(codeBitDepth);
+
+            for (int code = 0; code < (1 << codeBitDepth); code++)
+            {
+                codeLevels.push_back(grid.getLevel(code));
+            }
+        }
+
+        const int bytesPerCode = codeLevels.size() > 256 ? 2 : 1;
+
+        // Temporary file to hold the codes, each section's code for every channel in turn
+        auto codesFile = juce::File::getSpecialLocation(juce::File::tempDirectory).getNonexistentChildFile("BitCrushedStream", ".codes");
+        std::unique_ptr<juce::FileOutputStream> output(codesFile.createOutputStream());
+
+        if (output == nullptr)
+        {
+            return nullptr;
+        }
+
+        // Resample stage, each block of the file is scaled by the gain as it is read, so the values are the same as those of the
+        // whole sample normalised
+        HoldValueReader valueReader(numChannels, length, sections, gain, [&reader](juce::AudioSampleBuffer& block, int startSample, int numToRead)
+                                    {
+                                        reader->read(&block, 0, numToRead, startSample, true, true);
+                                    });
+
+        // What each channel's quantising has reached, carried from one block to the next
+        int DPCMIndex[StreamRing::numChannels] = { -1, -1 };
+        BRRCodec::History encodeHistory[StreamRing::numChannels];
+        BRRCodec::History decodeHistory[StreamRing::numChannels];
+
+        std::vector<juce::uint8> eightBitCodes;
+        std::vector<juce::uint16> sixteenBitCodes;
+        std::vector<juce::uint8> BRRBlocks;
+        std::vector<juce::int16> BRRDecoded;
+        std::vector<char> interleaved;
+
+        int numPending = 0;     // Values carried over from the last block, (BRR encodes whole blocks of 16)
+        bool written = true;
+        bool stopped = false;
+
+        {
+            PerformanceCounters::ScopedStageTimer timer(processor.getPerformanceCounters(), PerformanceCounters::Stage::quantise);
+
+            while (written && !valueReader.isFinished())
+            {
+                // Give up on this render as soon as there is a newer one to do, as only the most recent request is wanted
+                if (threadShouldExit() || isRenderSuperseded())
+                {
+                    stopped = true;
+                    break;
+                }
+
+                const int numValues = valueReader.readNextBlock();
+                const bool isLastBlock = valueReader.isFinished();
+
+                streamValues.setSize(numCodeChannels, numPending + numValues, true, false, true);
+
+                if (mono)
+                {
+                    const float* channelValues[StreamRing::numChannels] = {};
+
+                    for (int channel = 0; channel < numChannels; channel++)
+                    {
+                        channelValues[channel] = valueReader.getValues(channel);
+                    }
+
+                    ProjectCodeAudioProcessor::mixHoldValuesToMono(channelValues, numChannels, numValues, streamValues.getWritePointer(0, numPending));
+                }
+                else
+                {
+                    for (int channel = 0; channel < numChannels; channel++)
+                    {
+                        juce::FloatVectorOperations::copy(streamValues.getWritePointer(channel, numPending), valueReader.getValues(channel), numValues);
+                    }
+                }
+
+                int numToEncode = numPending + numValues;
+                numToEncode -= (renderParams.BRR && !isLastBlock) ? numToEncode % BRRCodec::samplesPerBlock : 0;
+
+                // Quantise stage, with the same kernels as for a sample held in memory
+                eightBitCodes.resize((size_t)numToEncode);
+                sixteenBitCodes.resize((size_t)numToEncode);
+                interleaved.resize((size_t)numToEncode * (size_t)numCodeChannels * (size_t)bytesPerCode);
+
+                for (int channel = 0; channel < numCodeChannels; channel++)
+                {
+                    const float* values = streamValues.getReadPointer(channel);
+
+                    if (renderParams.waveRAM)
+                    {
+                        const WaveRAMFrames frames(values, numToEncode, renderParams.volumeShift);
+
+                        for (int i = 0; i < numToEncode; i++)
+                        {
+                            eightBitCodes[(size_t)i] = (juce::uint8)frames.getNibble(i);
+                        }
+                    }
+                    else if (renderParams.directSound)
+                    {
+                        const DirectSoundSample directSample(values, numToEncode);
+
+                        for (int i = 0; i < numToEncode; i++)
+                        {
+                            eightBitCodes[(size_t)i] = (juce::uint8)(directSample.getData()[i] + 128);
+                        }
+                    }
+                    else if (renderParams.BRR)
+                    {
+                        const int numBlocks = BRRCodec::getNumBlocks(numToEncode);
+                        BRRBlocks.resize((size_t)numBlocks * BRRCodec::bytesPerBlock);
+                        BRRDecoded.resize((size_t)numBlocks * BRRCodec::samplesPerBlock);
+
+                        BRRCodec::encode(values, numToEncode, BRRBlocks.data(), encodeHistory[channel], isLastBlock);
+                        BRRCodec::decode(BRRBlocks.data(), numBlocks, BRRDecoded.data(), decodeHistory[channel]);
+
+                        for (int i = 0; i < numToEncode; i++)
+                        {
+                            sixteenBitCodes[(size_t)i] = (juce::uint16)juce::jmax(0, BRRDecoded[(size_t)i] * 2 + 32767);
+                        }
+                    }
+                    else if (bytesPerCode == 1)
+                    {
+                        ProjectCodeAudioProcessor::quantiseChannelCodes(values, numToEncode, renderParams.console, renderParams.bitDepth,
+                                                                        renderParams.DPCM ? renderParams.DPCMBit : 0, eightBitCodes.data(), DPCMIndex[channel]);
+                    }
+                    else
+                    {
+                        ProjectCodeAudioProcessor::quantiseChannelCodes(values, numToEncode, renderParams.console, renderParams.bitDepth,
+                                                                        renderParams.DPCM ? renderParams.DPCMBit : 0, sixteenBitCodes.data(), DPCMIndex[channel]);
+                    }
+
+                    // Each section's code for every channel in turn, as the streamer reads them
+                    for (int i = 0; i < numToEncode; i++)
+                    {
+                        const size_t offset = ((size_t)i * (size_t)numCodeChannels + (size_t)channel) * (size_t)bytesPerCode;
+
+                        if (bytesPerCode == 1)
+                        {
+                            interleaved[offset] = (char)eightBitCodes[(size_t)i];
+                        }
+                        else
+                        {
+                            std::memcpy(interleaved.data() + offset, &sixteenBitCodes[(size_t)i], sizeof(juce::uint16));
+                        }
+                    }
+                }
+
+                written = output->write(interleaved.data(), interleaved.size());
+
+                // Carry any values that didn't fill a BRR block over to the front, for the next block
+                numPending = numPending + numValues - numToEncode;
+
+                for (int channel = 0; channel < numCodeChannels; channel++)
+                {
+                    juce::FloatVectorOperations::copy(streamValues.getWritePointer(channel), streamValues.getReadPointer(channel, numToEncode), numPending);
+                }
+            }
+        }
+
+        output->flush();
+        written = written && output->getStatus().wasOk();
+        output = nullptr;   // Close the file so the streamer can read it
+
+        if (!written || stopped)
+        {
+            codesFile.deleteFile();
+            return nullptr;
+        }
+
+        // The streamer owns the source from here, so it outlives any voice still reading it
+        StreamSource::Ptr newSource = new StreamSource(codesFile, length, numCodeChannels, reader->sampleRate, sections, numCodes, std::move(codeLevels));
+        processor.getSampleStreamer().addSource(newSource.get());
+
+        // The head is a ring's length, so a note can play from memory while the streamer reads in what comes after it. It is
+        // expanded from the codes just written, with 4 samples of silence on the end for the voice to interpolate into, (when
+        // the sample is no longer than the head)
+        const int headLength = juce::jmin(length, StreamRing::ringSize);
+        auto head = std::make_shared<juce::AudioSampleBuffer>(numCodeChannels, headLength + 4);
+        juce::FileInputStream headInput(codesFile);
+        juce::MemoryBlock headCodes;
+
+        if (!headInput.openedOk() || !newSource->readSamples(headInput, 0, headLength, *head, headCodes))
+        {
+            return nullptr;
+        }
+
+        head->clear(headLength, 4);
+
+        streamedSource = newSource;
+        streamedKey = key;
+        streamedHead.data = std::move(head);
+        streamedHead.length = headLength;
+        streamedHead.sampleRate = reader->sampleRate;
+    }
+
+    auto newSound = buildSound(streamedHead, renderParams, renderRange);
+    newSound->setStreamSource(streamedSource.get());
+
+    return newSound;
+}
+
+bool SampleRenderer::isRenderSuperseded() const
+{
+    const juce::ScopedLock sl(requestLock);
+    return renderRequested;
+}
+
+std::shared_ptr<const CrushedSound::PitchVariantArray> SampleRenderer::buildPitchVariants(const LevelCodes& codes, double sampleRate)
+{
+    auto variants = std::make_shared<CrushedSound::PitchVariantArray>();
+
+    const int numChannels = codes.getNumChannels();
+    const juce::AudioSampleBuffer* source = nullptr;    // Data the next octave is rendered from, (the codes themselves for the first)
+    int length = codes.getNumSamples();
+
+    // Each chunk of codes expanded for the first octave, along with the samples either side of it the filter reaches
+    constexpr int reach = CrushKernels::halfBandReach;
+    std::vector<float> codeChunk((size_t)(2 * pitchVariantChunkSize + 2 * reach));
+
+    while ((int)variants->size() < maxPitchVariants && length >= minPitchVariantLength)
+    {
+        const int newLength = (length + 1) / 2;
+
+        // 4 samples of silence on the end for the voice to interpolate into, as for the main data
+        auto newData = std::make_shared<juce::AudioSampleBuffer>(numChannels, newLength + 4);
+        newData->clear();
+
+        for (int channel = 0; channel < numChannels; channel++)
+        {
+            float* destination = newData->getWritePointer(channel);
+
+            if (source != nullptr)
+            {
+                CrushKernels::halveSampleRate(source->getReadPointer(channel), length, destination);
+                continue;
+            }
+
+            // The first octave is filtered straight from the codes, so they are never expanded to one float per sample in full
+            for (int start = 0; start < newLength; start += pitchVariantChunkSize)
+            {
+                const int numOutputs = juce::jmin(pitchVariantChunkSize, newLength - start);
+
+                codes.expand(channel, 2 * start - reach, 2 * (numOutputs - 1) + 2 * reach + 1, codeChunk.data());
+                CrushKernels::halveSampleRateBlock(codeChunk.data() + reach, numOutputs, destination + start);
+            }
+        }
+
+        length = newLength;
+        sampleRate /= 2.0;
+        source = newData.get();
+
+        variants->push_back({ std::move(newData), length, sampleRate });
+    }
+
+    return variants;
+}
+
+void SampleRenderer::updateStageBytes()
+{
+    auto getBufferBytes = [](const juce::AudioSampleBuffer* buffer)
+    {
+        return buffer != nullptr ? (size_t)buffer->getNumChannels() * (size_t)buffer->getNumSamples() * sizeof(float) : (size_t)0;
+    };
+
+    size_t bytes = getBufferBytes(&resampledValues) + (quantisedCodes != nullptr ? quantisedCodes->getNumBytes() : 0)
+                 + (quantisedWave != nullptr ? quantisedWave->getNumBytes() : 0)
+                 + (quantisedDirect != nullptr ? quantisedDirect->getNumBytes() : 0)
+                 + getBufferBytes(streamedHead.data.get()) + getBufferBytes(&streamValues);
+
+    if (pitchVariantData != nullptr)
+    {
+        for (auto& variant : *pitchVariantData)
+        {
+            bytes += getBufferBytes(variant.data.get());
+        }
+    }
+
+    stageBytes = bytes;
+}
+
+// Makes a newly rendered sound available to the audio thread
+void SampleRenderer::publishSound(CrushedSound::Ptr newSound)
+{
+    releasePool.add(newSound.get());    // Keep the sound alive here until it is no longer used anywhere else
+
+    {
+        const juce::ScopedLock sl(latestSoundLock);
+        latestSound = newSound;
+    }
+
+    newSound->incReferenceCount();  // Reference held on behalf of the pending slot, dropped by whoever takes the sound out of it
+
+    // If the audio thread didn't pick up the previous sound in time, it is replaced and its pending reference dropped
+    if (auto* skippedSound = pendingSound.exchange(newSound.get()))
+    {
+        skippedSound->decReferenceCountWithoutDeleting();
+    }
+}
+
+// Frees any sounds whose only remaining reference is the release pool's own
+void SampleRenderer::releaseUnusedSounds()
+{
+    for (int i = releasePool.size(); --i >= 0;)
+    {
+        if (releasePool.getObjectPointerUnchecked(i)->getReferenceCount() == 1)
+        {
+            releasePool.remove(i);
+        }
+    }
+}
@@ -0,0 +1,174 @@
+/*
+  ==================================================================================
+
+    Header file for the background renderer of a JUCE VST video game sample
+    emulation plugin. The renderer processes (bit crushes) the sample on its own
+    thread, and hands each newly rendered sound over to the audio thread without
+    the audio thread ever having to wait on a lock or free any memory
+
+  ==================================================================================
+*/
+
+#pragma once
+
+#include <JuceHeader.h>
+#include "Parameters.h"
+#include "CrushedSampler.h"
+#include "RenderCache.h"
+
+class ProjectCodeAudioProcessor;
+
+//==============================================================================
+/**
+    Thread which renders the processed sample whenever a render is requested.
+
+    Only the most recent request is rendered. The render is split into stages
+    (resample, normalise, quantise, then build the sound), where the quantise
+    stage stores its output compactly as level codes at the emulated sample
+    rate, (or as wave RAM frames for the GameBoy or a Direct Sound sample for
+    the GBA), and the output of
+    each stage is cached along with the parameters it depends on, so a change
+    only redoes the stages after it. A change to the root note or note range
+    only builds a new sound around the existing data. Octaves of the data can be
+    pre-rendered as pitch variants too, after the quantise stage, for the voices
+    to play notes far above the root note from. Finished renders are also
+    kept in a memory budgeted cache, so switching back to a recent setting just
+    builds a new sound around the cached data. The finished sound is published
+    through an atomic pointer, which the audio thread picks up at the start of
+    the next block. Every published sound is also kept in a release pool, so the
+    last reference to a sound is always dropped on this thread rather than on the
+    audio thread.
+
+    A sample too long to be held in memory is rendered a block at a time from
+    its file, through the same stages, into a temporary file of level codes
+    instead, with only its head kept in memory, and the voices stream the rest
+    from the disk.
+*/
+class SampleRenderer : public juce::Thread
+{
+public:
+    SampleRenderer(ProjectCodeAudioProcessor& p);
+    ~SampleRenderer() override;
+
+    // Asks for the sample to be rendered with the given parameters (called from the message thread)
+    void requestRender(const Parameters& renderParams, const juce::BigInteger& renderRange);
+
+    // Swaps a newly rendered sound, if there is one, into the sampler (called from the audio thread, lock-free)
+    void swapInNextSound(CrushedSynthesiser& synth);
+
+    // Returns the most recently rendered sound, (e.g. so it can be exported)
+    CrushedSound::Ptr getLatestSound() const;
+
+    // Changes the memory the render cache may use, (applied on the renderer thread before the next render)
+    void setCacheBudget(size_t budgetBytes);
+
+    // Returns the render cache's hit, miss and eviction counts and memory use
+    RenderCache::Stats getCacheStats() const;
+
+    // Memory held by the cached stage outputs, (updated after each render)
+    size_t getStageBytes() const noexcept { return stageBytes.load(); }
+
+    static constexpr size_t defaultCacheBudgetBytes{ 64 * 1024 * 1024 };    // Enough for a few dozen renders of a 10 second stereo sample
+
+    void run() override;
+
+private:
+    // Parameters the resample and normalise stages depend on. Normalising has no parameters of its own, so it is done
+    // along with the resampling and shares its cache entry. Only the value each section is held at is kept, (one per
+    // emulated sample), as that is all the later stages read. The sections are of the sample file's own rate, so the
+    // host's rate doesn't come into it, (the voices do the one conversion to the host's rate as they play)
+    struct ResampleKey
+    {
+        int sampleGeneration = 0;   // Which loaded sample the data came from, (which also sets the rate it is converted from)
+        float sampleRate = 0;       // Sample rate being emulated
+
+        bool operator==(const ResampleKey& other) const noexcept
+        {
+            return sampleGeneration == other.sampleGeneration && sampleRate == other.sampleRate;
+        }
+    };
+
+    // Parameters the quantise stage depends on, (on top of the resample stage's)
+    struct QuantiseKey
+    {
+        bool DPCM = false;  // Whether DPCM is being used
+        int bitDepth = 0;   // Number of bits for the amplitude
+        int DPCMBit = 0;    // The bit size of the DPCM
+        bool BRR = false;   // Whether the data is encoded as BRR blocks instead
+        bool waveRAM = false;   // Or as wave RAM frames
+        int volumeShift = 0;    // The wave channel's volume shift, (only used with wave RAM frames)
+        bool directSound = false;   // Or as a Direct Sound sample
+
+        bool operator==(const QuantiseKey& other) const noexcept
+        {
+            return BRR == other.BRR && waveRAM == other.waveRAM && directSound == other.directSound && (!waveRAM || volumeShift == other.volumeShift)
+                && (BRR || waveRAM || directSound || (DPCM == other.DPCM && bitDepth == other.bitDepth && (!DPCM || DPCMBit == other.DPCMBit)));
+        }
+    };
+
+    // Renders a sound with the given parameters, only redoing the stages whose parameters have changed
+    CrushedSound::Ptr renderSound(const Parameters& renderParams, const juce::BigInteger& renderRange);
+
+    // Builds a sound around rendered data, with the root note and note range to be played with
+    CrushedSound::Ptr buildSound(const RenderCache::Entry& rendered, const Parameters& renderParams, const juce::BigInteger& renderRange);
+
+    // Renders a streamed sample from its file into a temporary file of codes, (unless the parameters are the same as last time), and builds a
+    // sound to stream it. Gives up, returning nullptr, if a newer render is requested part way through
+    CrushedSound::Ptr renderStreamedSound(const juce::File& file, int sampleGeneration, const Parameters& renderParams, const juce::BigInteger& renderRange);
+
+    // Whether a render has been requested since the one in progress was taken
+    bool isRenderSuperseded() const;
+
+    // Pre-renders octaves of the codes, each one filtered and at half the sample rate of the one before, until they get too short
+    static std::shared_ptr<const CrushedSound::PitchVariantArray> buildPitchVariants(const LevelCodes& codes, double sampleRate);
+
+    static constexpr int maxPitchVariants{ 10 };        // Most octaves pre-rendered, (enough to cover every MIDI note)
+    static constexpr int minPitchVariantLength{ 16 };   // Shortest data an octave is pre-rendered from
+    static constexpr int pitchVariantChunkSize{ 4096 }; // Samples of the first octave filtered from each chunk of codes expanded
+
+    void updateStageBytes();                        // Works out the memory held by the cached stage outputs
+    void publishSound(CrushedSound::Ptr newSound);  // Makes a newly rendered sound available to the audio thread
+    void releaseUnusedSounds();                     // Frees any sounds which are no longer used by the sampler or a voice
+
+    ProjectCodeAudioProcessor& processor;           // The processor whose sample is to be rendered
+
+    juce::CriticalSection requestLock;              // Protects the requested render below
+    Parameters requestedParams;                     // Parameters of the most recently requested render
+    juce::BigInteger requestedRange;                // MIDI note range of the most recently requested render
+    bool renderRequested = false;                   // Whether there is a request that has not been rendered yet
+
+    std::atomic<CrushedSound*> pendingSound{ nullptr };     // Rendered sound waiting to be picked up by the audio thread (holds its own reference)
+
+    juce::ReferenceCountedArray<CrushedSound> releasePool;  // Every sound published that may still be in use, only touched on this thread
+
+    // Cached stage outputs, only touched on this thread
+    ResampleKey resampledKey;                       // Parameters the hold values were rendered with
+    juce::AudioSampleBuffer resampledValues;        // Value of each section after the resample and normalise stages, (one per emulated sample)
+    int resampledLength = 0;                        // Number of samples of the original sample the hold values stand for
+    double resampledSourceRate = 0;                 // Sample rate of the original sample the hold values came from
+    bool resampledValid = false;                    // Whether the hold values have been rendered
+
+    QuantiseKey quantisedKey;                                           // Parameters the quantised data was rendered with
+    std::shared_ptr<const LevelCodes> quantisedCodes;   // Level codes from the quantise stage, (shared with the sounds built from it)
+    std::shared_ptr<const WaveRAMFrames> quantisedWave; // Or wave RAM frames, (only one of these is set)
+    std::shared_ptr<const DirectSoundSample> quantisedDirect;   // Or a Direct Sound sample
+
+    std::shared_ptr<const CrushedSound::PitchVariantArray> pitchVariantData;    // Octaves pre-rendered from the quantised data, (null until wanted)
+
+    RenderCache renderCache{ defaultCacheBudgetBytes };     // Recently used renders, only touched on this thread apart from its statistics
+    std::atomic<size_t> requestedCacheBudget{ defaultCacheBudgetBytes };    // Budget to apply to the render cache
+
+    // The streamed render, only touched on this thread
+    RenderCache::Key streamedKey;                   // Parameters the streamed sample was rendered with
+    StreamSource::Ptr streamedSource;               // Temporary file holding the streamed sample's codes, (null if the sample isn't streamed)
+    RenderCache::Entry streamedHead;                // The start of the processed streamed sample, kept in memory
+    juce::AudioSampleBuffer streamValues;           // Hold values of each block of a streamed sample as they are quantised, (reused between renders)
+    juce::AudioFormatManager streamFormatManager;   // Creates readers for streamed samples' files
+
+    std::atomic<size_t> stageBytes{ 0 };            // Memory held by the cached stage outputs
+
+    juce::CriticalSection latestSoundLock;          // Protects the latest sound below
+    CrushedSound::Ptr latestSound;                  // The most recently rendered sound
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(SampleRenderer)
+};
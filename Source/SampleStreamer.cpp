@@ -0,0 +1,257 @@
+/*
+  ==================================================================================
+
+    Implementation file for the disk streaming of a JUCE VST video game sample
+    emulation plugin. Samples too long to be held in memory are processed into a
+    temporary file of level codes, and each voice plays them from a ring buffer which a
+    background thread keeps filled ahead of it, so the audio thread never touches
+    the disk
+
+  ==================================================================================
+*/
+
+#include "SampleStreamer.h"
+
+//==============================================================================
+StreamSource::StreamSource(const juce::File& codesFile, juce::int64 lengthInSamples, int channels, double rate,
+                           const CrushKernels::HoldSections& codeSections, int codesPerChannel, std::vector<float> codeLevels)
+    : file(codesFile), length(lengthInSamples), numChannels(channels), sampleRate(rate),
+      sections(codeSections), numCodes(codesPerChannel), levels(std::move(codeLevels))
+{
+}
+
+StreamSource::~StreamSource()
+{
+    file.deleteFile();  // The file was only ever a temporary home for the processed data
+}
+
+bool StreamSource::readSamples(juce::InputStream& input, juce::int64 startSample, int numSamples, juce::AudioSampleBuffer& destination, juce::MemoryBlock& codeBuffer) const
+{
+    const int start = (int)juce::jmin(startSample, length);
+    const int end = (int)juce::jmin((juce::int64)start + numSamples, length);
+
+    if (start >= end || numCodes <= 0)
+    {
+        destination.clear(0, numSamples);
+        return true;
+    }
+
+    // Only the codes of the sections the range covers are read, every channel's at once as they are stored together
+    const int firstSection = juce::jmin(sections.getSection(start), numCodes - 1);
+    const int lastSection = juce::jmin(sections.getSection(end - 1), numCodes - 1);
+    const int bytesPerCode = getBytesPerCode();
+    const auto numBytes = (size_t)(lastSection - firstSection + 1) * (size_t)numChannels * (size_t)bytesPerCode;
+
+    codeBuffer.ensureSize(numBytes);
+
+    if (!input.setPosition((juce::int64)firstSection * numChannels * bytesPerCode) || input.read(codeBuffer.getData(), (int)numBytes) != (int)numBytes)
+    {
+        destination.clear(0, numSamples);
+        return false;
+    }
+
+    const auto* eightBitCodes = static_cast<const juce::uint8*>(codeBuffer.getData());
+    const auto* sixteenBitCodes = static_cast<const juce::uint16*>(codeBuffer.getData());
+
+    for (int channel = 0; channel < destination.getNumChannels(); channel++)
+    {
+        const int sourceChannel = juce::jmin(channel, numChannels - 1);
+
+        CrushKernels::expandSections(sections, numCodes, (int)length, start, numSamples, destination.getWritePointer(channel), [&](int section)
+        {
+            const auto index = (size_t)(section - firstSection) * (size_t)numChannels + (size_t)sourceChannel;
+            return levels[bytesPerCode == 1 ? (size_t)eightBitCodes[index] : (size_t)sixteenBitCodes[index]];
+        });
+    }
+
+    return true;
+}
+
+//==============================================================================
+StreamRing::StreamRing()
+{
+    samples.calloc((size_t)numChannels * ringSize);
+}
+
+juce::uint32 StreamRing::requestSource(StreamSource* source, juce::int64 startPosition) noexcept
+{
+    requestedSource.store(source, std::memory_order_relaxed);
+    requestedStart.store(startPosition, std::memory_order_relaxed);
+    readPosition.store(startPosition, std::memory_order_relaxed);
+
+    // Publish the request number last, so the streamer sees the source and position that go with it
+    auto request = requestNumber.load(std::memory_order_relaxed) + 1;
+    requestNumber.store(request, std::memory_order_release);
+    return request;
+}
+
+juce::int64 StreamRing::getWrittenEnd(juce::uint32 request, juce::int64 startPosition) const noexcept
+{
+    auto packed = writtenEnd.load(std::memory_order_acquire);
+
+    // Only trust data written for this request, (the top bits hold the low bits of the request number)
+    if ((juce::uint32)(packed >> positionBits) == (request & 0xffff))
+    {
+        return packed & positionMask;
+    }
+
+    return startPosition;
+}
+
+//==============================================================================
+SampleStreamer::SampleStreamer(int numRings)
+    : juce::Thread("Sample Streamer")
+{
+    for (int i = 0; i < numRings; i++)
+    {
+        rings.add(new StreamRing());
+    }
+}
+
+SampleStreamer::~SampleStreamer()
+{
+    stopThread(4000);
+}
+
+void SampleStreamer::addSource(StreamSource* source)
+{
+    const juce::ScopedLock sl(sourcesLock);
+    sources.add(source);
+}
+
+size_t SampleStreamer::getMemoryBytes() const noexcept
+{
+    return ((size_t)rings.size() + 1) * StreamRing::numChannels * sizeof(float) * StreamRing::ringSize;
+}
+
+juce::int64 SampleStreamer::getUnderruns() const noexcept
+{
+    juce::int64 total = 0;
+    for (auto* ring : rings)
+    {
+        total += ring->getUnderruns();
+    }
+    return total;
+}
+
+//==============================================================================
+void SampleStreamer::run()
+{
+    while (!threadShouldExit())
+    {
+        bool readAnything = false;
+
+        for (auto* ring : rings)
+        {
+            readAnything = fillRing(*ring) || readAnything;
+        }
+
+        releaseUnusedSources();
+
+        // Keep going straight away while there is reading to do, otherwise poll often enough to stay ahead of the voices
+        if (!readAnything)
+        {
+            bool anySources;
+            {
+                const juce::ScopedLock sl(sourcesLock);
+                anySources = !sources.isEmpty();
+            }
+
+            wait(anySources ? 2 : 50);
+        }
+    }
+}
+
+bool SampleStreamer::fillRing(StreamRing& ring)
+{
+    // Start streaming for a new request, (a new note, or nothing once the voice has stopped)
+    auto request = ring.requestNumber.load(std::memory_order_acquire);
+
+    if (request != ring.servedRequest)
+    {
+        ring.servedRequest = request;
+        ring.servedSource = ring.requestedSource.load(std::memory_order_relaxed);
+        ring.servedStart = ring.requestedStart.load(std::memory_order_relaxed);
+        ring.fillPosition = ring.servedStart;
+        ring.writtenEnd.store(((juce::int64)(request & 0xffff) << StreamRing::positionBits) | ring.fillPosition, std::memory_order_release);
+
+        // Only open the file again if it is a different source from the last note's
+        if (ring.servedSource != nullptr && ring.servedSource != ring.inputSource)
+        {
+            ring.input = ring.servedSource->getFile().createInputStream();
+            ring.inputSource = ring.servedSource;
+        }
+    }
+
+    if (ring.servedSource == nullptr || ring.input == nullptr)
+    {
+        return false;
+    }
+
+    // Read as far as the ring has room for, without overwriting anything the voice may still need
+    auto readLimit = juce::jmin(ring.servedSource->getLength(),
+                                juce::jmax(ring.readPosition.load(std::memory_order_acquire), ring.servedStart) + StreamRing::ringSize);
+    auto numToRead = (int)juce::jmin((juce::int64)readBlockSize, readLimit - ring.fillPosition);
+
+    if (numToRead <= 0)
+    {
+        return false;
+    }
+
+    ring.servedSource->readSamples(*ring.input, ring.fillPosition, numToRead, readBuffer, codeBuffer);
+
+    // Copy the block into the ring, wrapping round at the end
+    auto ringStart = (int)(ring.fillPosition & (StreamRing::ringSize - 1));
+    auto numBeforeWrap = juce::jmin(numToRead, StreamRing::ringSize - ringStart);
+
+    for (int channel = 0; channel < StreamRing::numChannels; channel++)
+    {
+        float* ringChannel = ring.samples.get() + (size_t)channel * StreamRing::ringSize;
+        const float* readChannel = readBuffer.getReadPointer(channel);
+
+        juce::FloatVectorOperations::copy(ringChannel + ringStart, readChannel, numBeforeWrap);
+        juce::FloatVectorOperations::copy(ringChannel, readChannel + numBeforeWrap, numToRead - numBeforeWrap);
+    }
+
+    ring.fillPosition += numToRead;
+    ring.writtenEnd.store(((juce::int64)(ring.servedRequest & 0xffff) << StreamRing::positionBits) | ring.fillPosition, std::memory_order_release);
+
+    return true;
+}
+
+// Frees any sources whose only remaining reference is the streamer's own, once no ring can be reading them
+void SampleStreamer::releaseUnusedSources()
+{
+    const juce::ScopedLock sl(sourcesLock);
+
+    for (int i = sources.size(); --i >= 0;)
+    {
+        auto* source = sources.getObjectPointerUnchecked(i);
+
+        if (source->getReferenceCount() != 1)
+        {
+            continue;
+        }
+
+        // No sound refers to it any more, so no new note can ask for it, but a ring may still be on an old request
+        bool inUse = false;
+        for (auto* ring : rings)
+        {
+            inUse = inUse || ring->servedSource == source || ring->requestedSource.load() == source;
+        }
+
+        if (!inUse)
+        {
+            for (auto* ring : rings)
+            {
+                if (ring->inputSource == source)
+                {
+                    ring->input = nullptr;
+                    ring->inputSource = nullptr;
+                }
+            }
+
+            sources.remove(i);
+        }
+    }
+}
@@ -0,0 +1,172 @@
+/*
+  ==================================================================================
+
+    Header file for the disk streaming of a JUCE VST video game sample emulation
+    plugin. Samples too long to be held in memory are processed into a temporary
+    file of level codes, and each voice plays them from a ring buffer which a background thread
+    keeps filled ahead of it, so the audio thread never touches the disk
+
+  ==================================================================================
+*/
+
+#pragma once
+
+#include <JuceHeader.h>
+#include "CrushKernels.h"
+
+//==============================================================================
+/**
+    A processed (bit crushed) sample which is played from a file rather than from
+    memory. The sound playing it keeps the first part (the head) in memory, so a
+    note can start straight away while the rest is read in behind it.
+
+    The file holds a level code per emulated sample, as LevelCodes does in memory,
+    with each section's code for every channel in turn. Codes are 8 bits if there
+    are up to 256 levels and 16 bits (in the machine's byte order) otherwise, and
+    each stands for its level held over the section of the sample it covers, so
+    the file is a fraction of the size of the processed float data.
+*/
+class StreamSource : public juce::ReferenceCountedObject
+{
+public:
+    // Takes over the file of codesPerChannel codes per channel, which is deleted along with the source. Code i stands for
+    // codeLevels[i], held over its section of the lengthInSamples samples
+    StreamSource(const juce::File& codesFile, juce::int64 lengthInSamples, int channels, double rate,
+                 const CrushKernels::HoldSections& codeSections, int codesPerChannel, std::vector<float> codeLevels);
+    ~StreamSource() override;
+
+    using Ptr = juce::ReferenceCountedObjectPtr<StreamSource>;
+
+    const juce::File& getFile() const noexcept      { return file; }
+    juce::int64 getLength() const noexcept          { return length; }
+    int getNumChannels() const noexcept             { return numChannels; }
+    double getSampleRate() const noexcept           { return sampleRate; }
+
+    // Bytes each code takes in the file
+    int getBytesPerCode() const noexcept            { return levels.size() > 256 ? 2 : 1; }
+
+    // Reads the codes for numSamples samples from startSample out of the file, and expands them into every channel of the
+    // destination from its first sample, (channels past the source's own repeat its first, and anything past the end is
+    // silence). codeBuffer is where the codes are read to. Returns false if the file couldn't be read
+    bool readSamples(juce::InputStream& input, juce::int64 startSample, int numSamples, juce::AudioSampleBuffer& destination, juce::MemoryBlock& codeBuffer) const;
+
+private:
+    const juce::File file;                          // Temporary file holding the level codes
+    const juce::int64 length;                       // Number of samples the codes stand for
+    const int numChannels;                          // Number of channels in the file
+    const double sampleRate;                        // Sample rate the data is played back at for the root note
+    const CrushKernels::HoldSections sections;      // The section of the sample each code covers
+    const int numCodes;                             // Number of codes per channel
+    const std::vector<float> levels;                // The level each code stands for
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(StreamSource)
+};
+
+//==============================================================================
+/**
+    The read-ahead window of one voice. The voice asks for a source to be streamed
+    from a position when a note starts, and the streamer thread fills the ring from
+    there, staying at most a ring's length ahead of where the voice is reading.
+
+    Positions are sample indices into the source. What has been written is packed
+    together with the number of the request it was written for, so a voice never
+    reads data left over from its previous note.
+*/
+class StreamRing
+{
+public:
+    static constexpr int ringSize{ 16384 };                 // Samples of read-ahead per voice, (a power of 2)
+    static constexpr int numChannels{ 2 };                  // Channels kept, (the voice only plays up to 2)
+
+    StreamRing();
+
+    //==============================================================================
+    // Audio thread. Asks for the source to be streamed from startPosition onwards, returning the request's number
+    juce::uint32 requestSource(StreamSource* source, juce::int64 startPosition) noexcept;
+
+    // Audio thread. Where the data written for the request ends, (startPosition if none has been written yet)
+    juce::int64 getWrittenEnd(juce::uint32 request, juce::int64 startPosition) const noexcept;
+
+    // Audio thread. The sample at a position which has been written for the current request
+    float getSample(int channel, juce::int64 position) const noexcept
+    {
+        return samples[(size_t)channel * ringSize + (size_t)(position & (ringSize - 1))];
+    }
+
+    // Audio thread. Lets the streamer overwrite everything before this position
+    void setReadPosition(juce::int64 position) noexcept     { readPosition.store(position, std::memory_order_release); }
+
+    // Audio thread. Counts samples that had to be played as silence because the streamer hadn't read them in time
+    void addUnderruns(int numSamples) noexcept              { underruns.fetch_add(numSamples, std::memory_order_relaxed); }
+
+    juce::int64 getUnderruns() const noexcept               { return underruns.load(); }
+
+private:
+    friend class SampleStreamer;
+
+    static constexpr int positionBits{ 48 };                                    // Bits of the packed written end used for the position
+    static constexpr juce::int64 positionMask{ ((juce::int64)1 << positionBits) - 1 };
+
+    juce::HeapBlock<float> samples;                         // The ring itself, (each channel's ringSize samples one after the other)
+
+    // Written by the audio thread
+    std::atomic<StreamSource*> requestedSource{ nullptr };  // Source to stream, (kept alive by the streamer's registry)
+    std::atomic<juce::int64> requestedStart{ 0 };           // Position to start streaming from
+    std::atomic<juce::uint32> requestNumber{ 0 };           // Increased for each request, (published last)
+    std::atomic<juce::int64> readPosition{ 0 };             // Earliest position the voice still needs
+    std::atomic<juce::int64> underruns{ 0 };                // Samples played as silence for want of data
+
+    // Written by the streamer thread
+    std::atomic<juce::int64> writtenEnd{ 0 };               // Request number (top bits) and end of the data written for it
+
+    // Only used by the streamer thread
+    juce::uint32 servedRequest{ 0 };                        // Request being streamed
+    StreamSource* servedSource{ nullptr };                  // Source being streamed, (nullptr once the voice has stopped)
+    juce::int64 servedStart{ 0 };                           // Position the served request started from
+    juce::int64 fillPosition{ 0 };                          // Next position to be read from the source
+    std::unique_ptr<juce::FileInputStream> input;           // Reads the served source's file
+    StreamSource* inputSource{ nullptr };                   // Source the input was opened for
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(StreamRing)
+};
+
+//==============================================================================
+/**
+    Thread which keeps every voice's ring filled from the disk, and owns the
+    streamed sources so they are never deleted while a ring may be reading them.
+*/
+class SampleStreamer : public juce::Thread
+{
+public:
+    explicit SampleStreamer(int numRings);
+    ~SampleStreamer() override;
+
+    // The ring for a voice, (one per voice, made up front)
+    StreamRing* getRing(int index) const noexcept   { return rings[index]; }
+
+    // Keeps a new source alive until no sound or ring uses it any more, (called from the renderer thread)
+    void addSource(StreamSource* source);
+
+    // Memory used by the rings, (fixed however long the streamed samples are)
+    size_t getMemoryBytes() const noexcept;
+
+    // Total samples played as silence because the disk couldn't keep up
+    juce::int64 getUnderruns() const noexcept;
+
+    void run() override;
+
+private:
+    bool fillRing(StreamRing& ring);    // Reads the next block into the ring if there's room, returning whether anything was read
+    void releaseUnusedSources();        // Frees sources no longer used by any sound or ring
+
+    static constexpr int readBlockSize{ 4096 };     // Most samples read from the disk in one go
+
+    juce::OwnedArray<StreamRing> rings;             // One ring per voice
+    juce::AudioSampleBuffer readBuffer{ StreamRing::numChannels, readBlockSize };  // Where each block is expanded to before being copied into a ring
+    juce::MemoryBlock codeBuffer;                   // Where each block's codes are read to
+
+    juce::CriticalSection sourcesLock;              // Protects the sources, (never taken on the audio thread)
+    juce::ReferenceCountedArray<StreamSource> sources;  // Every source that may still be used
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(SampleStreamer)
+};
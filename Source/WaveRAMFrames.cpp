@@ -0,0 +1,53 @@
+/*
+  ==================================================================================
+
+    Implementation file for the GameBoy wave channel frames of a JUCE VST video
+    game sample emulation plugin. A sample is played on the GameBoy by rewriting
+    the wave channel's 16 bytes of wave RAM, 32 samples of 4 bits, one frame
+    after another, so the processed sample is kept as that stream of frames
+
+  ==================================================================================
+*/
+
+#include "WaveRAMFrames.h"
+
+//==============================================================================
+WaveRAMFrames::WaveRAMFrames(const float* data, int samplesToEncode, int shift)
+    : numSamples(samplesToEncode),
+      numFrames((samplesToEncode + samplesPerFrame - 1) / samplesPerFrame),
+      volumeShift(juce::jlimit(0, numVolumeShifts - 1, shift))
+{
+    // After the shift only 16 >> shift values are left, spread evenly about the middle
+    const int maxShifted = 15 >> volumeShift;
+
+    for (int nibble = 0; nibble < 16; nibble++)
+    {
+        outputLevels[nibble] = (float)(2 * (nibble >> volumeShift) - maxShifted) / 15.0f;
+    }
+
+    // Pad with the value nearest the middle, so the end of the last frame is as quiet as possible
+    const int padding = (maxShifted / 2) << volumeShift;
+    bytes.assign((size_t)numFrames * bytesPerFrame, (juce::uint8)((padding << 4) | padding));
+
+    // Round each sample to the nearest of the values that survive the shift, then shift it back up to a nibble
+    for (int i = 0; i < numSamples; i++)
+    {
+        const int shifted = juce::jlimit(0, maxShifted, juce::roundToInt((data[i] + 1.0f) * 0.5f * (float)maxShifted));
+        const int nibble = shifted << volumeShift;
+
+        auto& byte = bytes[(size_t)(i >> 1)];
+        byte = (i & 1) ? (juce::uint8)((byte & 0xf0) | nibble) : (juce::uint8)((byte & 0x0f) | (nibble << 4));
+    }
+}
+
+void WaveRAMFrames::expand(juce::AudioSampleBuffer& destination) const
+{
+    destination.setSize(1, numSamples + 4, false, false, true);
+    destination.clear();
+
+    float* channelData = destination.getWritePointer(0);
+    for (int i = 0; i < numSamples; i++)
+    {
+        channelData[i] = outputLevels[getNibble(i)];
+    }
+}
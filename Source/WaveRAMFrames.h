@@ -0,0 +1,75 @@
+/*
+  ==================================================================================
+
+    Header file for the GameBoy wave channel frames of a JUCE VST video game
+    sample emulation plugin. A sample is played on the GameBoy by rewriting the
+    wave channel's 16 bytes of wave RAM, 32 samples of 4 bits, one frame after
+    another, so the processed sample is kept as that stream of frames
+
+  ==================================================================================
+*/
+
+#pragma once
+
+#include <JuceHeader.h>
+
+//==============================================================================
+/**
+    A processed sample as GameBoy wave RAM frames. Each frame is 32 samples of 4
+    bits packed two to a byte with the first in the high nibble, as wave RAM
+    holds them, at the rate the wave channel's timer steps through them.
+
+    The channel's volume shift (100%, 50% or 25%) is applied to each nibble as it
+    is played, as on the hardware, so the encoder only uses the nibble values that
+    survive the shift. The frames never change once encoded, so they can be shared
+    between sounds and read by any number of voices.
+*/
+class WaveRAMFrames
+{
+public:
+    static constexpr int samplesPerFrame{ 32 };
+    static constexpr int bytesPerFrame{ samplesPerFrame / 2 };
+    static constexpr int numVolumeShifts{ 3 };      // Shifts of 0 (100%), 1 (50%) and 2 (25%), (the channel's mute setting isn't used)
+
+    // Encodes numSamples samples (at the wave channel's rate, normalised to -1 to 1) into frames for the volume shift,
+    // with the last frame padded with the middle level
+    WaveRAMFrames(const float* data, int numSamples, int volumeShift);
+
+    int getNumSamples() const noexcept      { return numSamples; }
+    int getNumFrames() const noexcept       { return numFrames; }
+    int getVolumeShift() const noexcept     { return volumeShift; }
+
+    // A frame's 16 bytes, as they would be written to wave RAM
+    const juce::uint8* getFrame(int frame) const noexcept   { return bytes.data() + (size_t)frame * bytesPerFrame; }
+
+    // The 4 bit value of a sample, (index must be within the frames)
+    int getNibble(juce::int64 index) const noexcept
+    {
+        const int byte = bytes[(size_t)(index >> 1)];
+        return (index & 1) ? (byte & 0x0f) : (byte >> 4);
+    }
+
+    // The output level of each nibble value after the volume shift, centred on 0 as after the console's output capacitor
+    const float* getOutputLevels() const noexcept   { return outputLevels; }
+
+    // The output level of a sample, (silence past the end)
+    float getSample(juce::int64 index) const noexcept
+    {
+        return index < numSamples ? outputLevels[getNibble(index)] : 0.0f;
+    }
+
+    // Expands the frames into one float per sample, followed by 4 samples of silence as the voice expects of sample data
+    void expand(juce::AudioSampleBuffer& destination) const;
+
+    // Memory used by the frames
+    size_t getNumBytes() const noexcept     { return bytes.size(); }
+
+private:
+    const int numSamples;               // Number of samples of actual data
+    const int numFrames;                // Number of frames, (the last one padded)
+    const int volumeShift;              // Right shift applied to each nibble as it is played
+    std::vector<juce::uint8> bytes;     // Every frame one after the other
+    float outputLevels[16];             // Output level of each nibble value
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(WaveRAMFrames)
+};
@@ -0,0 +1,338 @@
+/*
+  ==================================================================================
+
+    Command line batch renderer for a JUCE VST video game sample emulation plugin.
+    Bit crushes every audio file in a directory (and its subdirectories) with the
+    parameters from a preset file, using every core, and writes each result as a
+    16 bit .wav file to an output directory with the same layout
+
+    Built as a JUCE console application from this file and the plugin's Source
+    files, with the same modules and JucePlugin_ preprocessor definitions as the
+    plugin (so the processor compiles the same way)
+
+    Usage: BatchRenderer <input directory> <preset.json> <output directory> [--threads N] [--dmc]
+
+    The preset holds any of the Parameters fields used by the bit crush, e.g.
+    { "console": "NES", "sampleRate": 33252.1, "bitDepth": 7, "DPCM": true, "DPCMBit": 1 }
+    or, for SNES BRR blocks, { "console": "SNES", "sampleRate": 32000, "BRR": true }
+    or, for GameBoy wave RAM frames at 50% volume, { "console": "GameBoy", "sampleRate": 8192, "volumeShift": 1 }
+    or, for GBA Direct Sound at a 13379 Hz mixing rate, { "console": "GBA", "sampleRate": 13379 }
+
+    With --dmc, each file is instead encoded as NES DMC data at the preset's
+    sample rate and written as a .dmc file, ready to include in a NES build
+
+  ==================================================================================
+*/
+
+#include <JuceHeader.h>
+#include <deque>
+#include <iostream>
+#include "../../Source/PluginProcessor.h"
+
+//==============================================================================
+/**
+    Job queue with one deque of jobs per worker. Each worker takes jobs from the
+    back of its own deque, and when that is empty steals from the front of the
+    others', so the work evens out when some files take longer than others.
+*/
+class WorkStealingQueue
+{
+public:
+    explicit WorkStealingQueue(int numWorkers)
+    {
+        for (int i = 0; i < numWorkers; i++)
+        {
+            workerJobs.add(new WorkerJobs());
+        }
+    }
+
+    // Deals the jobs 0 to numJobs - 1 out between the workers, (before any of them have started)
+    void distribute(int numJobs)
+    {
+        for (int job = 0; job < numJobs; job++)
+        {
+            workerJobs[job % workerJobs.size()]->jobs.push_back(job);
+        }
+    }
+
+    // Gets the next job for the worker, returning false once there are none left anywhere
+    bool getNextJob(int worker, int& job)
+    {
+        // Own jobs first, from the back
+        {
+            auto& own = *workerJobs[worker];
+            const juce::ScopedLock sl(own.lock);
+
+            if (!own.jobs.empty())
+            {
+                job = own.jobs.back();
+                own.jobs.pop_back();
+                return true;
+            }
+        }
+
+        // Then steal from the front of the other workers' jobs, starting with the next worker along
+        for (int i = 1; i < workerJobs.size(); i++)
+        {
+            auto& victim = *workerJobs[(worker + i) % workerJobs.size()];
+            const juce::ScopedLock sl(victim.lock);
+
+            if (!victim.jobs.empty())
+            {
+                job = victim.jobs.front();
+                victim.jobs.pop_front();
+                return true;
+            }
+        }
+
+        return false;
+    }
+
+private:
+    struct WorkerJobs
+    {
+        juce::CriticalSection lock;     // Protects the jobs, (only contended when another worker steals)
+        std::deque<int> jobs;           // Indices of the files still to be rendered
+    };
+
+    juce::OwnedArray<WorkerJobs> workerJobs;    // Jobs for each worker
+};
+
+//==============================================================================
+/**
+    Thread which renders files from the queue until there are none left. Each
+    worker has its own processor, so they never share any scratch storage, and
+    only ever holds the one file it is rendering in memory.
+*/
+class BatchWorker : public juce::Thread
+{
+public:
+    BatchWorker(int index, WorkStealingQueue& jobQueue, const juce::Array<juce::File>& filesToRender,
+                const juce::File& inputDir, const juce::File& outputDir, const Parameters& renderParams, bool encodeDMC,
+                std::atomic<int>& numDone, std::atomic<int>& numFailed)
+        : juce::Thread("Batch Worker " + juce::String(index)), workerIndex(index), queue(jobQueue), files(filesToRender),
+          inputDirectory(inputDir), outputDirectory(outputDir), params(renderParams), DMC(encodeDMC), filesDone(numDone), filesFailed(numFailed)
+    {
+        formatManager.registerBasicFormats();
+    }
+
+    void run() override
+    {
+        int job;
+
+        while (!threadShouldExit() && queue.getNextJob(workerIndex, job))
+        {
+            if (renderFile(files[job]))
+            {
+                ++filesDone;
+            }
+            else
+            {
+                ++filesFailed;
+            }
+        }
+    }
+
+private:
+    // Bit crushes one file and writes it to the matching place in the output directory
+    bool renderFile(const juce::File& file)
+    {
+        std::unique_ptr<juce::AudioFormatReader> reader(formatManager.createReaderFor(file));
+
+        // Check the file could be read
+        if (reader == nullptr || reader->lengthInSamples <= 0)
+        {
+            std::cerr << "Could not read " << file.getFullPathName() << std::endl;
+            return false;
+        }
+
+        auto numSamples = (int)reader->lengthInSamples;
+        juce::AudioSampleBuffer sampleData((int)reader->numChannels, numSamples);
+        reader->read(&sampleData, 0, numSamples, 0, true, true);
+
+        if (DMC)
+        {
+            return writeDMCFile(file, sampleData, reader->sampleRate);
+        }
+
+        // Crushed from the file's own rate, so the output stays at that rate
+        processor.bitCrushSample(&sampleData, reader->sampleRate, params);
+
+        // Keep the file's place under the input directory, always as a .wav
+        auto outputFile = outputDirectory.getChildFile(file.getRelativePathFrom(inputDirectory)).withFileExtension(".wav");
+        outputFile.getParentDirectory().createDirectory();
+        outputFile.deleteFile();
+
+        auto outputStream = std::make_unique<juce::FileOutputStream>(outputFile);
+
+        if (!outputStream->openedOk())
+        {
+            std::cerr << "Could not write " << outputFile.getFullPathName() << std::endl;
+            return false;
+        }
+
+        // The writer takes ownership of the stream if it is created
+        std::unique_ptr<juce::AudioFormatWriter> writer(wavFormat.createWriterFor(outputStream.get(), reader->sampleRate,
+                                                                                  (unsigned int)sampleData.getNumChannels(), 16, {}, 0));
+        if (writer == nullptr)
+        {
+            return false;
+        }
+
+        outputStream.release();
+
+        return writer->writeFromAudioSampleBuffer(sampleData, 0, numSamples);
+    }
+
+    // Encodes one file as NES DMC data and writes it to the matching place in the output directory
+    bool writeDMCFile(const juce::File& file, const juce::AudioSampleBuffer& sampleData, double sampleRate)
+    {
+        auto DMCData = processor.encodeSampleDMC(sampleData, sampleRate, params.sampleRate);
+        auto outputFile = outputDirectory.getChildFile(file.getRelativePathFrom(inputDirectory)).withFileExtension(".dmc");
+        outputFile.getParentDirectory().createDirectory();
+
+        if (DMCData.getSize() == 0 || !outputFile.replaceWithData(DMCData.getData(), DMCData.getSize()))
+        {
+            std::cerr << "Could not write " << outputFile.getFullPathName() << std::endl;
+            return false;
+        }
+
+        return true;
+    }
+
+    const int workerIndex;                      // Which of the queue's deques belongs to this worker
+    WorkStealingQueue& queue;                   // Where the jobs come from
+    const juce::Array<juce::File>& files;       // Every file to be rendered
+    const juce::File inputDirectory;            // Directory the files were found in
+    const juce::File outputDirectory;           // Directory the rendered files are written to
+    const Parameters params;                    // Parameters to bit crush with
+    const bool DMC;                             // Whether to write NES DMC data rather than bit crushed .wav files
+
+    std::atomic<int>& filesDone;                // Shared count of files rendered
+    std::atomic<int>& filesFailed;              // Shared count of files which couldn't be rendered
+
+    ProjectCodeAudioProcessor processor;        // This worker's own processor, whose bit crush is used
+    juce::AudioFormatManager formatManager;     // Creates readers for the input files
+    juce::WavAudioFormat wavFormat;             // The .wav file format the output is written in
+};
+
+//==============================================================================
+// Reads the bit crush parameters from a preset file, keeping the defaults for anything it doesn't set
+static bool readPreset(const juce::File& presetFile, Parameters& presetParams)
+{
+    auto preset = juce::JSON::parse(presetFile.loadFileAsString());
+
+    if (!preset.isObject())
+    {
+        return false;
+    }
+
+    presetParams.console = ConsoleTables::getConsoleFromName(preset.getProperty("console", ConsoleTables::getConsoleName(presetParams.console)).toString());
+    presetParams.sampleRate = (float)preset.getProperty("sampleRate", presetParams.sampleRate);
+    presetParams.bitDepth = (int)preset.getProperty("bitDepth", presetParams.bitDepth);
+    presetParams.DPCM = (bool)preset.getProperty("DPCM", presetParams.DPCM);
+    presetParams.DPCMBit = (int)preset.getProperty("DPCMBit", presetParams.DPCMBit);
+    presetParams.BRR = (bool)preset.getProperty("BRR", presetParams.BRR);
+
+    // The GameBoy only plays samples through its wave channel, so its frames are used unless the preset says otherwise
+    presetParams.waveRAM = (bool)preset.getProperty("waveRAM", presetParams.console == Console::GameBoy);
+    presetParams.volumeShift = juce::jlimit(0, WaveRAMFrames::numVolumeShifts - 1, (int)preset.getProperty("volumeShift", presetParams.volumeShift));
+
+    // Likewise the GBA only plays samples through Direct Sound
+    presetParams.directSound = (bool)preset.getProperty("directSound", presetParams.console == Console::GBA);
+
+    return presetParams.sampleRate > 0 && presetParams.bitDepth >= 1 && presetParams.DPCMBit >= 1;
+}
+
+int main(int argc, char* argv[])
+{
+    juce::ScopedJuceInitialiser_GUI juceInitialiser;    // The processor's parameters need the message manager to exist
+
+    juce::StringArray args;
+    for (int i = 1; i < argc; i++)
+    {
+        args.add(argv[i]);
+    }
+
+    if (args.size() < 3)
+    {
+        std::cout << "Usage: BatchRenderer <input directory> <preset.json> <output directory> [--threads N] [--dmc]" << std::endl;
+        return 1;
+    }
+
+    const juce::File inputDirectory = juce::File::getCurrentWorkingDirectory().getChildFile(args[0]);
+    const juce::File presetFile = juce::File::getCurrentWorkingDirectory().getChildFile(args[1]);
+    const juce::File outputDirectory = juce::File::getCurrentWorkingDirectory().getChildFile(args[2]);
+
+    int numThreads = juce::SystemStats::getNumCpus();
+    int threadsArg = args.indexOf("--threads");
+    if (threadsArg >= 0 && threadsArg + 1 < args.size())
+    {
+        numThreads = juce::jmax(1, args[threadsArg + 1].getIntValue());
+    }
+
+    Parameters presetParams;
+    if (!readPreset(presetFile, presetParams))
+    {
+        std::cerr << "Could not read a valid preset from " << presetFile.getFullPathName() << std::endl;
+        return 1;
+    }
+
+    if (!inputDirectory.isDirectory() || !outputDirectory.createDirectory())
+    {
+        std::cerr << "Input must be a directory and the output directory must be writable" << std::endl;
+        return 1;
+    }
+
+    auto files = inputDirectory.findChildFiles(juce::File::findFiles, true, "*.wav;*.aif;*.aiff;*.flac;*.ogg");
+    numThreads = juce::jmax(1, juce::jmin(numThreads, files.size()));
+
+    std::cout << "Rendering " << files.size() << " files on " << numThreads << " threads" << std::endl;
+
+    WorkStealingQueue queue(numThreads);
+    queue.distribute(files.size());
+
+    std::atomic<int> filesDone{ 0 }, filesFailed{ 0 };
+
+    // The workers are created here, so their processors are made on the message thread
+    juce::OwnedArray<BatchWorker> workers;
+    for (int i = 0; i < numThreads; i++)
+    {
+        workers.add(new BatchWorker(i, queue, files, inputDirectory, outputDirectory, presetParams, args.contains("--dmc"), filesDone, filesFailed));
+    }
+
+    const auto startTime = juce::Time::getMillisecondCounterHiRes();
+
+    for (auto* worker : workers)
+    {
+        worker->startThread();
+    }
+
+    // Report progress every second until every worker has run out of jobs
+    auto isRunning = [&workers]()
+    {
+        for (auto* worker : workers)
+        {
+            if (worker->isThreadRunning())
+            {
+                return true;
+            }
+        }
+        return false;
+    };
+
+    while (isRunning())
+    {
+        juce::Thread::sleep(1000);
+
+        double seconds = (juce::Time::getMillisecondCounterHiRes() - startTime) / 1000.0;
+        std::cout << filesDone.load() << "/" << files.size() << " files, "
+                  << juce::String(filesDone.load() / juce::jmax(seconds, 0.001), 1) << " files/sec" << std::endl;
+    }
+
+    double seconds = (juce::Time::getMillisecondCounterHiRes() - startTime) / 1000.0;
+    std::cout << "Rendered " << filesDone.load() << " files (" << filesFailed.load() << " failed) in "
+              << juce::String(seconds, 2) << " s, " << juce::String(filesDone.load() / juce::jmax(seconds, 0.001), 1) << " files/sec" << std::endl;
+
+    return filesFailed.load() == 0 ? 0 : 1;
+}